@@ -0,0 +1,81 @@
+# assets.awk - pack the graphics listed in assets.txt into one blob
+#
+# usage: gawk -f assets.awk assets.txt turmoil.mag > assets.h
+#
+# Reads turmoil.mag once.  The output is a single byte array in its own
+# .assets section, preceded there by an index of offset, length and VRAM
+# address entries that setup() copies from, and an ASSET_ define for the
+# first index entry of each asset.
+
+BEGIN { n = 0 }
+
+FNR == 1 { file++ }
+
+file == 1 && /^[^#]/ && NF >= 5 {
+	name[n] = $1
+	rec[n] = $2
+	first[n] = $3
+	count[n] = $4
+	vram[n] = $5
+	pad[n] = $6 + 0
+	n++
+	next
+}
+
+file == 2 {
+	split($0, f, ":")
+	if (f[1] == "CH" || f[1] == "CO" || f[1] == "SP")
+		data[f[1], nrec[f[1]]++] = f[2]
+}
+
+# hex digits to a line of C bytes
+function bytes(hex,    s, i)
+{
+	s = "\t"
+	for (i = 1; i < length(hex); i += 2)
+		s = s "0x" substr(hex, i, 2) ","
+	return s
+}
+
+END {
+	print "// generated by assets.awk from assets.txt and turmoil.mag"
+	offset = 0
+	entries = 0
+	for (a = 0; a < n; a++) {
+		hex = ""
+		for (r = first[a]; r < first[a] + count[a]; r++) {
+			if (!((rec[a], r) in data)) {
+				printf "assets.awk: %s: no %s record %d\n", name[a], rec[a], r > "/dev/stderr"
+				exit 1
+			}
+			hex = hex data[rec[a], r]
+		}
+		hex = hex substr(hex, 1, pad[a] * 2)
+		blob[a] = hex
+		len = length(hex) / 2
+
+		printf "#define ASSET_%s %d\n", toupper(name[a]), entries
+		nv = split(vram[a], v, ",")
+		for (i = 1; i <= nv; i++) {
+			index_[entries++] = sprintf("\t{%d, %d, %s}, // %s", offset, len, v[i] == "-" ? "ASSET_NO_VRAM" : v[i], name[a])
+		}
+		offset += len
+	}
+	print "#define ASSET_NO_VRAM 0xffff"
+	print ""
+	print "static const struct {"
+	print "\tu16 offset, length, vram;"
+	print "} asset_index[] __attribute__((section(\".assets\"))) = {"
+	for (i = 0; i < entries; i++)
+		print index_[i]
+	print "};"
+	print ""
+	print "static const u8 assets[] __attribute__((section(\".assets\"))) = {"
+	for (a = 0; a < n; a++) {
+		printf "\t// %s\n", name[a]
+		hex = blob[a]
+		for (i = 1; i <= length(hex); i += 16)
+			print bytes(substr(hex, i, 16))
+	}
+	print "};"
+}
@@ -0,0 +1,272 @@
+/*
+ *  bench.c - VDP primitive benchmark cartridge for the Turmoil clone
+ *
+ * Times vdp_memset(), vdp_write(), vdp_write8() and
+ * set_vdp_write_address() from main.c with the TMS9901 timer, which
+ * counts down once every 64 CPU cycles (timer_start() and timer_read()
+ * in main.c).  Run it on the real thing or an emulator that models the
+ * wait states; "make bench" builds turmoil_bench.bin.
+ *
+ * Every call is timed in a loop long enough for the timer's resolution
+ * and the empty loop is taken off again.  Sources are read from
+ * cartridge ROM (>6000), scratchpad (a 32 byte buffer) and expansion RAM
+ * (>A000), and written to the sprite pattern table which is unused here.
+ *
+ * The screen only has digits.  All numbers are CPU cycles per call:
+ *
+ *   rows  0-11  size 1-2048   vdp_memset  vdp_write ROM  PAD  RAM
+ *   row  12     0             fixed overhead per call
+ *   row  13     256           cycles per 256 bytes
+ *   rows 14-21  size 8-1024   vdp_write8 ROM  PAD  RAM
+ *   rows 22,23  as rows 12,13 for vdp_write8
+ *
+ * plus set_vdp_write_address() in the last column of row 14 and the
+ * empty loop in row 15.  The scratchpad columns stop at 32 bytes.
+ *
+ * Rows 16-19 of the last column compare the byte loops crt0.c and
+ * main.c used to have with the word loops of now: copying .data and
+ * clearing .bss at startup, then clearing enemy[] and bullet[] for a
+ * level, old and new for each.
+ * Overhead and rate are fitted from 512 and 1024 bytes, 16 and 32 for
+ * scratchpad.
+ */
+
+// only the VDP routines are wanted, the game itself is left out
+static void turmoil_main(void) __attribute__((unused));
+#define main turmoil_main
+#include "main.c"
+#undef main
+
+#define DEST SPRPAT // 2K of VRAM that isn't on screen
+
+enum { ROM, PAD, RAM };
+
+// Source in scratchpad, .bss is there.  Kept small, with main.c's data
+// the link fails once .bss runs into the stack reserve (see linkfile).
+static u8 pad[32];
+static u16 loop; // cycles of the empty timing loop
+
+static const u8 *source(u16 where)
+{
+	if (where == ROM)
+		return (const u8 *)0x6000;
+	if (where == PAD)
+		return pad;
+	return (const u8 *)0xA000;
+}
+
+// Each of these makes n calls and returns the timer ticks they took.
+// n times the call has to stay below 0x3fff ticks, the timer is 14 bits.
+
+static u16 time_loop(const u8 *src, u16 size, u16 n)
+{
+	(void)src; (void)size;
+	timer_start();
+	u16 t = timer_read();
+	do {
+		asm volatile ("");
+	} while (--n);
+	return (t - timer_read()) & 0x3fff;
+}
+
+static u16 time_address(const u8 *src, u16 size, u16 n)
+{
+	(void)src; (void)size;
+	timer_start();
+	u16 t = timer_read();
+	do {
+		set_vdp_write_address(DEST);
+	} while (--n);
+	return (t - timer_read()) & 0x3fff;
+}
+
+static u16 time_memset(const u8 *src, u16 size, u16 n)
+{
+	(void)src;
+	timer_start();
+	u16 t = timer_read();
+	do {
+		vdp_memset(DEST, 0, size);
+	} while (--n);
+	return (t - timer_read()) & 0x3fff;
+}
+
+static u16 time_write(const u8 *src, u16 size, u16 n)
+{
+	timer_start();
+	u16 t = timer_read();
+	do {
+		vdp_write(DEST, src, size);
+	} while (--n);
+	return (t - timer_read()) & 0x3fff;
+}
+
+static u16 time_write8(const u8 *src, u16 size, u16 n)
+{
+	timer_start();
+	u16 t = timer_read();
+	do {
+		vdp_write8(DEST, src, size / 8);
+	} while (--n);
+	return (t - timer_read()) & 0x3fff;
+}
+
+// The old runtime, a byte at a time
+static void byte_copy(u8 *dst, const u8 *src, u16 count)
+{
+	while (count--)
+		*dst++ = *src++;
+}
+
+static void byte_set(u8 *dst, u8 byte, u16 count)
+{
+	while (count--)
+		*dst++ = byte;
+}
+
+// What crt0.c does for the sections of this cartridge.  The real
+// destination would be overwritten, so the copy and clear go to the
+// scratchpad buffer 32 bytes at a time, from ROM like the initial values.
+static void startup(u16 words)
+{
+	extern char __DATA_START[], __DATA_END[], __BSS_START[], __BSS_END[];
+	u16 data = __DATA_END - __DATA_START, bss = __BSS_END - __BSS_START;
+
+	for (u16 i = 0; i < data; i += sizeof(pad)) {
+		u16 n = data - i;
+		if (n > sizeof(pad))
+			n = sizeof(pad);
+		if (words)
+			memcpy(pad, (u8 *)0x6000 + i, n);
+		else
+			byte_copy(pad, (u8 *)0x6000 + i, n);
+	}
+	for (u16 i = 0; i < bss; i += sizeof(pad)) {
+		u16 n = bss - i;
+		if (n > sizeof(pad))
+			n = sizeof(pad);
+		if (words)
+			memset(pad, 0, n);
+		else
+			byte_set(pad, 0, n);
+	}
+}
+
+// as in level_reset()
+static void level_clear(u16 words)
+{
+	if (words) {
+		memset(enemy, 0, sizeof(enemy));
+		memset(bullet, 0, sizeof(bullet));
+	} else {
+		byte_set((u8 *)enemy, 0, sizeof(enemy));
+		byte_set((u8 *)bullet, 0, sizeof(bullet));
+	}
+}
+
+// cycles per call of run(words), 16 calls
+static u32 runtime(void (*run)(u16), u16 words)
+{
+	timer_start();
+	u16 t = timer_read();
+	for (u16 i = 0; i < 16; i++)
+		run(words);
+	u32 c = (u32)((t - timer_read()) & 0x3fff) << 2; // 64 cycles a tick, 16 calls
+	return c > loop ? c - loop : 0;
+}
+
+// v << up >> down a bit at a time, a u32 shift by a variable count
+// would be a libgcc call
+static u32 scale(u32 v, u16 up, u16 down)
+{
+	for (; up > down; up--)
+		v <<= 1;
+	for (; down > up; down--)
+		v >>= 1;
+	return v;
+}
+
+// cycles per call of size 1 << k, with 2048 >> k calls but at least 4
+static u32 cycles(u16 (*time)(const u8 *, u16, u16), const u8 *src, u16 k)
+{
+	u16 shift = k < 9 ? 11 - k : 2;
+	u32 c = scale(time(src, 1 << k, 1 << shift), 6, shift);
+	return c > loop ? c - loop : 0;
+}
+
+static void print_num(u16 row, u16 col, u32 v, u16 digits)
+{
+	static const u32 places[] = {100000, 10000, 1000, 100, 10, 1};
+
+	if (v > 999999)
+		v = 999999;
+	set_vdp_write_address(SCRTAB + row * 32 + col);
+	for (u16 i = 6 - digits; i < 6; i++) {
+		u8 d = '0';
+		while (v >= places[i]) {
+			v -= places[i];
+			d++;
+		}
+		VDP_WRITE_DATA_REG = d;
+	}
+}
+
+// One column of cycles for sizes 1 << first to 1 << last starting at
+// row, then the overhead and cycles per 256 bytes fitted from sizes
+// 1 << fit and 1 << (fit + 1) at fit_row and the row below.
+static void column(u16 (*time)(const u8 *, u16, u16), const u8 *src,
+	u16 row, u16 col, u16 first, u16 last, u16 fit, u16 fit_row)
+{
+	u32 a = 0, b = 0;
+
+	for (u16 k = first; k <= last; k++) {
+		u32 c = cycles(time, src, k);
+		print_num(row + k - first, col, c, 6);
+		if (k == fit)
+			a = c;
+		if (k == fit + 1)
+			b = c;
+	}
+
+	print_num(fit_row, col, 2 * a > b ? 2 * a - b : 0, 6);
+	b = b > a ? b - a : 0;
+	print_num(fit_row + 1, col, scale(b, 8, fit), 6);
+}
+
+int main(void)
+{
+	init_vdp();
+	ovl_load(OVL_INIT);
+	setup();
+	vdp_memset(SPRTAB, 0xd0, 1); // no sprites
+
+	loop = time_loop(0, 0, 2048) >> 5; // 64 cycles a tick, 2048 calls
+
+	for (u16 k = 0; k < 12; k++)
+		print_num(k, 0, 1 << k, 4);
+	print_num(12, 0, 0, 4);
+	print_num(13, 0, 256, 4);
+	column(time_memset, 0, 0, 5, 0, 11, 9, 12);
+	column(time_write, source(ROM), 0, 12, 0, 11, 9, 12);
+	column(time_write, source(PAD), 0, 19, 0, 5, 4, 12);
+	column(time_write, source(RAM), 0, 26, 0, 11, 9, 12);
+
+	for (u16 k = 3; k < 11; k++)
+		print_num(14 + k - 3, 0, 1 << k, 4);
+	print_num(22, 0, 0, 4);
+	print_num(23, 0, 256, 4);
+	column(time_write8, source(ROM), 14, 5, 3, 10, 9, 22);
+	column(time_write8, source(PAD), 14, 12, 3, 5, 4, 22);
+	column(time_write8, source(RAM), 14, 19, 3, 10, 9, 22);
+
+	print_num(14, 26, cycles(time_address, 0, 0), 6);
+	print_num(15, 26, loop, 6);
+
+	print_num(16, 26, runtime(startup, 0), 6);
+	print_num(17, 26, runtime(startup, 1), 6);
+	print_num(18, 26, runtime(level_clear, 0), 6);
+	print_num(19, 26, runtime(level_clear, 1), 6);
+
+	for (;;)
+		;
+}
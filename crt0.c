@@ -10,28 +10,39 @@ extern "C"
 
 void _start2(void)
 {
-  /* Fill .data section with initial values */
+  /* Fill .data section with initial values
+  *
+  * A word at a time, the linker script starts both sections and the
+  * initial values on even addresses.  An odd end gets one more byte. */
   {
     extern char __VAL_START;
     extern char __DATA_START;
     extern char __DATA_END;
-    char *src = &__VAL_START;
-    char *dst = &__DATA_START;
-    while(dst < &__DATA_END)
+    int *src = (int*)&__VAL_START;
+    int *dst = (int*)&__DATA_START;
+    while((char*)dst < &__DATA_END - 1)
     {
       *dst++ = *src++;
     }
+    if((char*)dst < &__DATA_END)
+    {
+      *(char*)dst = *(char*)src;
+    }
   } 
 
   /* Erase .bss section */
   {
     extern char __BSS_START;
     extern char __BSS_END;
-    char *dst = &__BSS_START;
-    while(dst < &__BSS_END)
+    int *dst = (int*)&__BSS_START;
+    while((char*)dst < &__BSS_END - 1)
     {
       *dst++ = 0;
     }
+    if((char*)dst < &__BSS_END)
+    {
+      *(char*)dst = 0;
+    }
   }
 
 #ifdef __cplusplus
@@ -0,0 +1,380 @@
+/*
+ *  equiv.c - asm kernel equivalence cartridge for the Turmoil clone
+ *
+ * Runs the same pseudo-random cases through vdp_memset(), vdp_write(),
+ * vdp_write8(), vdp_unrle(), random(), memcpy(), memset(), abs16() and
+ * sound_tick() from main.c.  "make equiv" builds it twice, turmoil_equiv.bin with
+ * the inline asm kernels and turmoil_equiv_c.bin with the C kept next
+ * to them (-DC_KERNELS).  Run both on the real thing or an emulator and
+ * compare the screens.
+ *
+ * Each VDP case puts a guard byte on either side of its span, runs the
+ * kernel, writes a marker straight to the data port, which lands where
+ * the kernel left the VDP address, and reads it all back.  The case
+ * fails unless that is guard, the bytes the kernel should have written,
+ * marker, guard, r14 and r15 still hold the VDP ports and r13 (vdp_next)
+ * says the VDP address is unknown.  memcpy() and memset() cases are
+ * checked the same way in expansion RAM, at odd and even addresses.  random() is checked against the LFSR it
+ * implements, return value and seed, abs16() against plain C.  The sound
+ * chip can't be read back, so sound_tick() is checked on what it leaves
+ * in voice[] and noise.
+ *
+ * The screen only has digits.  One row per kernel:
+ *
+ *   row 0  vdp_memset    row 3  vdp_unrle    row 6  memset
+ *   row 1  vdp_write     row 4  random       row 7  abs16
+ *   row 2  vdp_write8    row 5  memcpy       row 8  sound_tick
+ *
+ * with the failed cases in column 0, a checksum of everything read back
+ * in column 5 and CPU cycles per call in column 12, timer reads
+ * included.  Both builds must show no failures and the same checksums,
+ * the difference in cycles is what the asm buys.
+ *
+ * Sources are in expansion RAM (>A000) and scratchpad, filled from a
+ * fixed seed.  Cartridge ROM isn't used, it differs between the builds.
+ * read_joystick() has no C version to compare with, C can't reach the
+ * CRU.
+ */
+
+#define VDP_READ // to check the results
+// only the kernels are wanted, the game itself is left out
+static void turmoil_main(void) __attribute__((unused));
+#define main turmoil_main
+#include "main.c"
+#undef main
+
+#define DEST SPRPAT // 2K of VRAM that isn't on screen
+#define CASES_SHIFT 8 // 256 cases a row, a power of two so cycles per call are a shift
+#define CASES (1 << CASES_SHIFT)
+#define GUARD 0x5a
+#define MARK 0xa5
+
+// Source in scratchpad, .bss is there.  Kept small, with main.c's data
+// the link fails once .bss runs into the stack reserve (see linkfile).
+static u8 pad[32];
+static u8 *const ram = (u8 *)0xA000; // 1K of sources
+static u8 *const rle = (u8 *)0xA400; // input for vdp_unrle()
+static u8 *const back = (u8 *)0xB000; // read back from VRAM
+static u8 *const want = (u8 *)0xB400; // what should have been written
+static u8 *const dest = (u8 *)0xB800; // for memcpy() and memset()
+static u16 *const tune = (u16 *)0xC000; // a step for each voice and the noise
+static typeof(voice[0]) *const expect = (void *)0xC010; // voice[] after sound_tick()
+static typeof(noise) *const expect_noise = (void *)0xC028;
+static u16 rng = 1;
+static u16 sum, failed; // of the current row
+static u32 ticks;
+
+// time one call, the 9901 timer counts down once every 64 cycles
+#define TIMED(call) do { \
+	u16 t = timer_read(); \
+	call; \
+	ticks += (t - timer_read()) & 0x3fff; \
+} while (0)
+
+// xorshift, the same cases whichever kernels are built
+static u16 next(void)
+{
+	rng ^= rng << 7;
+	rng ^= rng >> 9;
+	rng ^= rng << 8;
+	return rng;
+}
+
+// straight to the data port, not through a kernel under test
+static void fill(u16 addr, u8 ch, u16 count)
+{
+	u16 end = addr + count;
+
+	set_vdp_write_address(addr);
+	do {
+		VDP_WRITE_DATA_REG = ch;
+	} while (--count);
+	vdp_next = end; // not VDP_NOWHERE, so check() sees the kernel reset it
+}
+
+// After a kernel wrote count bytes at addr, which should be want[].
+// fill(addr - 1, GUARD, count + 3) came before it.
+static void check(u16 addr, u16 count)
+{
+	u16 bad = vdp_address_reg_addr != (u8 *)0x8C02 ||
+		vdp_write_data_reg_addr != (u8 *)0x8C00 ||
+		vdp_next != VDP_NOWHERE;
+
+	if (!bad) {
+		VDP_WRITE_DATA_REG = MARK;
+		vdp_read(addr - 1, back, count + 3);
+		bad = back[0] != GUARD || back[count+1] != MARK || back[count+2] != GUARD;
+		for (u16 i = 0; i < count; i++)
+			bad |= back[i+1] != want[i];
+		for (u16 i = 0; i < count + 3; i++)
+			sum = ((sum << 1) | (sum >> 15)) + back[i];
+	}
+	failed += bad;
+}
+
+// the same for count bytes at d in RAM
+static void check_ram(const u8 *d, u16 count)
+{
+	u16 bad = d[-1] != GUARD || d[count] != GUARD || vdp_next != VDP_NOWHERE;
+
+	for (u16 i = 0; i < count; i++)
+		bad |= d[i] != want[i];
+	for (u16 i = 0; i < count + 2; i++)
+		sum = ((sum << 1) | (sum >> 15)) + d[i-1];
+	failed += bad;
+}
+
+static void case_memset(void)
+{
+	u16 addr = DEST + 1 + (next() & 1023);
+	u16 count = 1 + (next() & 511);
+	u8 ch = next();
+
+	for (u16 i = 0; i < count; i++)
+		want[i] = ch;
+	fill(addr - 1, GUARD, count + 3);
+	TIMED(vdp_memset(addr, ch, count));
+	check(addr, count);
+}
+
+static void case_write(void)
+{
+	u16 addr = DEST + 1 + (next() & 1023);
+	u16 r = next();
+	u16 count = r & 1 ? 1 + ((r >> 1) & 31) : 1 + ((r >> 1) & 511);
+	const u8 *src = r & 1 ? pad + ((r >> 7) & (sizeof(pad) - count)) : ram + ((r >> 7) & 511);
+
+	for (u16 i = 0; i < count; i++)
+		want[i] = src[i];
+	fill(addr - 1, GUARD, count + 3);
+	TIMED(vdp_write(addr, src, count));
+	check(addr, count);
+}
+
+static void case_write8(void)
+{
+	u16 addr = DEST + 1 + (next() & 1023);
+	u16 r = next();
+	u16 count = r & 1 ? 1 + ((r >> 1) & 3) : 1 + ((r >> 1) & 63); // of 8 bytes
+	const u8 *src = r & 1 ? pad : ram + ((r >> 7) & 511);
+
+	for (u16 i = 0; i < count * 8; i++)
+		want[i] = src[i];
+	fill(addr - 1, GUARD, count * 8 + 3);
+	TIMED(vdp_write8(addr, src, count));
+	check(addr, count * 8);
+}
+
+// (count, byte) pairs of up to 512 bytes, possibly none
+static void case_unrle(void)
+{
+	u16 addr = DEST + 1 + (next() & 1023);
+	u16 limit = 1 + (next() & 511);
+	u16 count = 0;
+	u8 *p = rle;
+
+	for (;;) {
+		u16 n = next() & 0xff;
+		if (n == 0)
+			n = 255;
+		if (count + n > limit)
+			break;
+		u8 ch = next();
+		*p++ = n;
+		*p++ = ch;
+		while (n--)
+			want[count++] = ch;
+	}
+	*p = 0;
+	fill(addr - 1, GUARD, count + 3);
+	TIMED(vdp_unrle(addr, rle));
+	check(addr, count);
+}
+
+static void case_memcpy(void)
+{
+	u8 *d = dest + 1 + (next() & 1023);
+	u16 r = next();
+	u16 count = r & 511;
+	u8 *src = ram + ((r >> 9) & 511);
+
+	for (u16 i = 0; i < count; i++)
+		want[i] = src[i];
+	for (u16 i = 0; i < count + 2; i++)
+		d[i-1] = GUARD;
+	TIMED(memcpy(d, src, count));
+	check_ram(d, count);
+}
+
+static void case_memset_ram(void)
+{
+	u8 *d = dest + 1 + (next() & 1023);
+	u16 count = next() & 511;
+	u8 ch = next();
+
+	for (u16 i = 0; i < count; i++)
+		want[i] = ch;
+	for (u16 i = 0; i < count + 2; i++)
+		d[i-1] = GUARD;
+	TIMED(memset(d, ch, count));
+	check_ram(d, count);
+}
+
+// 16 calls from a random seed
+static void case_random(void)
+{
+	u16 model = next();
+
+	seed = model;
+	for (u16 i = 0; i < 16; i++) {
+		u16 r;
+		TIMED(r = random());
+		model = model & 1 ? (model >> 1) ^ 0xb400 : model >> 1;
+		failed += r != model || seed != model;
+		sum = ((sum << 1) | (sum >> 15)) + r;
+	}
+}
+
+static void case_abs(void)
+{
+	for (u16 i = 0; i < 16; i++) {
+		s16 v = next(), r;
+		TIMED(r = abs16(v));
+		failed += r != (s16)(v < 0 ? -v : v);
+		sum = ((sum << 1) | (sum >> 15)) + r;
+	}
+}
+
+// The voices and the noise each idle or a random step into a sound,
+// which may be its last, and stepped once.
+static void case_sound(void)
+{
+	for (u16 i = 0; i < 3; i++) {
+		u16 r = next();
+		u16 v = next();
+		if (r & 0x80)
+			v |= 0xf; // silent, the voice is freed
+		tune[i] = v;
+		voice[i].data = r & 1 ? 0 : tune + i;
+		voice[i].last = r & 0x100 ? v ^ (r & 0xf00f) : next();
+		voice[i].prio = 1 + ((r >> 1) & 3);
+		voice[i].rate = 1 + ((r >> 3) & 3);
+		voice[i].wait = 1 + ((r >> 5) & 1); // steps on 1
+
+		expect[i].data = voice[i].data;
+		expect[i].last = voice[i].last;
+		expect[i].prio = voice[i].prio;
+		expect[i].rate = voice[i].rate;
+		expect[i].wait = voice[i].wait;
+		if (expect[i].data && !--expect[i].wait) {
+			expect[i].wait = expect[i].rate;
+			expect[i].data++;
+			expect[i].last = v;
+			if ((v & 0xf) == 0xf) {
+				expect[i].data = 0;
+				expect[i].prio = PRIO_IDLE;
+			}
+		}
+	}
+
+	u16 r = next();
+	u8 *n = (u8 *)(tune + 3);
+	*n = r & 0x80 ? 0xff : next(); // 0xff ends the sound
+	noise.data = r & 1 ? 0 : n;
+	noise.last = r & 0x100 ? *n : next();
+	noise.rate = 1 + ((r >> 3) & 3);
+	noise.wait = 1 + ((r >> 5) & 1);
+
+	expect_noise->data = noise.data;
+	expect_noise->last = noise.last;
+	expect_noise->rate = noise.rate;
+	expect_noise->wait = noise.wait;
+	if (expect_noise->data && !--expect_noise->wait) {
+		expect_noise->wait = expect_noise->rate;
+		expect_noise->data++;
+		expect_noise->last = *n;
+		if (*n == 0xff)
+			expect_noise->data = 0;
+	}
+
+	TIMED(sound_tick());
+
+	u16 bad = vdp_next != VDP_NOWHERE;
+	for (u16 i = 0; i < 3; i++) {
+		bad |= voice[i].data != expect[i].data || voice[i].last != expect[i].last ||
+			voice[i].prio != expect[i].prio || voice[i].rate != expect[i].rate ||
+			voice[i].wait != expect[i].wait;
+		sum = ((sum << 1) | (sum >> 15)) + (voice[i].data ? voice[i].data - tune : 0xff);
+		sum = ((sum << 1) | (sum >> 15)) + voice[i].last;
+		sum = ((sum << 1) | (sum >> 15)) + (voice[i].prio << 8 | voice[i].wait);
+	}
+	bad |= noise.data != expect_noise->data || noise.last != expect_noise->last ||
+		noise.rate != expect_noise->rate || noise.wait != expect_noise->wait;
+	sum = ((sum << 1) | (sum >> 15)) + (noise.data ? 1 : 0);
+	sum = ((sum << 1) | (sum >> 15)) + (noise.last << 8 | noise.wait);
+	failed += bad;
+}
+
+static void print_num(u16 row, u16 col, u32 v, u16 digits)
+{
+	static const u32 places[] = {100000, 10000, 1000, 100, 10, 1};
+
+	if (v > 999999)
+		v = 999999;
+	set_vdp_write_address(SCRTAB + row * 32 + col);
+	for (u16 i = 6 - digits; i < 6; i++) {
+		u8 d = '0';
+		while (v >= places[i]) {
+			v -= places[i];
+			d++;
+		}
+		VDP_WRITE_DATA_REG = d;
+	}
+}
+
+// calls a case is 1 or 16.  The cycles per call are worked out with a
+// constant shift for each, a u32 division or variable shift would need
+// libgcc.
+static void row(u16 r, void (*run)(void), u16 calls)
+{
+	sum = 0;
+	failed = 0;
+	ticks = 0;
+	for (u16 i = 0; i < CASES; i++)
+		run();
+	print_num(r, 0, failed, 3);
+	print_num(r, 5, sum, 5);
+	if (calls == 16)
+		print_num(r, 12, (ticks << 6) >> (CASES_SHIFT + 4), 6);
+	else
+		print_num(r, 12, (ticks << 6) >> CASES_SHIFT, 6);
+}
+
+int main(void)
+{
+	init_vdp();
+	ovl_load(OVL_INIT);
+	setup();
+	fill(SPRTAB, 0xd0, 1); // no sprites
+	fill(SCRTAB, ' ', 768);
+
+	for (u16 i = 0; i < sizeof(pad); i++)
+		pad[i] = next();
+	for (u16 i = 0; i < 1024; i++)
+		ram[i] = next();
+	timer_start();
+
+	row(0, case_memset, 1);
+	row(1, case_write, 1);
+	row(2, case_write8, 1);
+	row(3, case_unrle, 1);
+	row(4, case_random, 16); // 16 calls a case
+	row(5, case_memcpy, 1);
+	row(6, case_memset_ram, 1);
+	row(7, case_abs, 16);
+	row(8, case_sound, 1);
+	sound_stop();
+
+	for (;;)
+		;
+}
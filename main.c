@@ -31,7 +31,35 @@ typedef unsigned short u16;
 typedef signed short s16;
 typedef unsigned long int u32;
 
-#include "graphics.h"
+#include "assets.h"
+#include "field.h"
+
+#define asset(n) (assets + asset_index[n].offset)
+#ifndef RECORD
+#include "attract.h"
+#else
+static const u8 attract_rle[] = {0}; // being recorded, see record.c
+#endif
+
+// The SPLIT_OPT build compiles the per-frame paths for speed and the
+// startup and level transition code for size, see "make split".
+#ifdef SPLIT_OPT
+#define HOT __attribute__((hot, optimize("O2", "unroll-loops")))
+#define COLD __attribute__((cold, optimize("Os")))
+#else
+#define HOT
+#define COLD
+#endif
+
+// The EA5 build keeps cold code in overlays that share one region of
+// lower expansion RAM, ovl_load() copies one in before it is called.
+// The cartridge links them into ROM and runs them in place.
+#ifdef tms9900
+#define OVERLAY(name) __attribute__((noinline, section(".ovl_" #name)))
+#else
+#define OVERLAY(name)
+#endif
+enum { OVL_NONE, OVL_INIT, OVL_LEVEL };
 
 // ship can move up or down every 4 frames
 // enemies animate every 5 frames
@@ -85,16 +113,28 @@ typedef unsigned long int u32;
 #define CLRTAB2 0x0800 // Char color table
 #define CLRTAB3 0x1000 // Char color table
 #define SCRTAB 0x1800  // Screen Table
+#define RBWTAB 0x1C00  // Screen Table for the rainbow between levels
 #define SPRTAB 0x1F80  // Sprite list table
 #define PATTAB 0x2000  // Char pattern table
 #define PATTAB2 0x2800 // Char pattern table
 #define PATTAB3 0x3000 // Char pattern table
 #define SPRPAT 0x3800  // Sprite patterns
-
-#define SPRTAB_BULLETS (SPRTAB)
+#define SPRPAT_HI 56   // sprite patterns 32-37 are at 56-61, see assets.txt
+#define VDP_NOWHERE 0xffff // vdp_next when the VDP address isn't known
+
+#ifdef BAND_BULLETS
+// one sprite per bullet, its red middle line is chars, see draw_bullet()
+#define SPRTAB_BULLET(i) (SPRTAB+(i)*4)
+#define SPRTAB_SHIP (SPRTAB+7*4)
+#define SPRTAB_ENEMIES (SPRTAB+8*4)
+#define SPRTAB_END (SPRTAB+15*4)
+#define BULLET_CH 0x70 // 16 chars of the line shifted, as in shifted_bg()
+#else
+#define SPRTAB_BULLET(i) (SPRTAB+(i)*8) // two sprites per bullet
 #define SPRTAB_SHIP (SPRTAB+14*4)
 #define SPRTAB_ENEMIES (SPRTAB+15*4)
 #define SPRTAB_END (SPRTAB+22*4)
+#endif
 
 static const u8 vdpini[] = {
 	0x02,		// VDP Register 0: 02 (Bitmap Mode)
@@ -127,6 +167,8 @@ typecasts troughout the code.
 // keep address and data addresses in global registers for fast access
 register volatile u8 *vdp_address_reg_addr asm("r14");
 register volatile u8 *vdp_write_data_reg_addr asm("r15");
+// VRAM address of the next data port write, as far as vdp_seek() knows
+register u16 vdp_next asm("r13");
 
 #define VDP_ADDRESS_REG     (*vdp_address_reg_addr)
 #define VDP_WRITE_DATA_REG  (*vdp_write_data_reg_addr)
@@ -137,7 +179,42 @@ register volatile u8 *vdp_write_data_reg_addr asm("r15");
 
 #define SND_REG      (*(volatile unsigned char*)0x8400)
 
-static inline void set_vdp_write_address(u16 addr)
+/*
+Workspace for the routines entered with BLWP, so callers don't have to
+save registers around them and the ports are already loaded.  They never
+nest, so both share it, which keeps scratchpad free for the stack.
+
+  VDP:   R0 address, R1 source, R2 count, R3 data port, R4 address port
+  sound: R5 byte one, R6 sound port, R0-R2 and R7-R10 scratch
+*/
+static u16 ws[16] __attribute__((used)) = {
+	0, 0, 0, 0x8C00, 0x8C02, 0x0100, 0x8400,
+};
+
+asm(
+	"	.pushsection .text\n"
+	"vdp_write8_vec:\n"
+	"	data ws, vdp_write8_ws\n"
+	"vdp_write8_ws:\n"
+	"	swpb r0\n"
+	"	movb r0,*r4\n"
+	"	swpb r0\n"
+	"	movb r0,*r4\n"
+	"1:	movb *r1+,*r3\n"
+	"	movb *r1+,*r3\n"
+	"	movb *r1+,*r3\n"
+	"	movb *r1+,*r3\n"
+	"	movb *r1+,*r3\n"
+	"	movb *r1+,*r3\n"
+	"	movb *r1+,*r3\n"
+	"	movb *r1+,*r3\n"
+	"	dec r2\n"
+	"	jne 1b\n"
+	"	rtwp\n"
+	"	.popsection\n"
+);
+
+static inline void vdp_address_setup(u16 addr)
 {
 	addr += 0x4000;
 	asm volatile (
@@ -151,11 +228,35 @@ static inline void set_vdp_write_address(u16 addr)
 	);
 }
 
+static inline void set_vdp_write_address(u16 addr)
+{
+	vdp_address_setup(addr);
+	vdp_next = VDP_NOWHERE;
+}
+
+// Set the write address for the n bytes that follow, unless the last
+// vdp_seek() left the VDP there already.
+static inline void vdp_seek(u16 addr, u8 n)
+{
+	if (addr != vdp_next)
+		vdp_address_setup(addr);
+	vdp_next = addr + n;
+}
 
-static void vdp_memset(u16 addr, u8 ch, u16 count)
+static inline void vdp_reg(u8 reg, u8 val)
+{
+	vdp_next = VDP_NOWHERE;
+	VDP_ADDRESS_REG = val;
+	VDP_ADDRESS_REG = 0x80 | reg;
+}
+
+// The asm kernels below keep the C they replace next to them, built
+// instead with -DC_KERNELS (turmoil_ckernels.bin).  equiv.c checks that
+// both do the same.
+static HOT void vdp_memset(u16 addr, u8 ch, u16 count)
 {
 	set_vdp_write_address(addr);
-#if 0
+#ifdef C_KERNELS
 	do {
 		VDP_WRITE_DATA_REG = ch;
 	} while (--count);
@@ -171,10 +272,10 @@ static void vdp_memset(u16 addr, u8 ch, u16 count)
 #endif
 }
 
-static void vdp_write(u16 addr, const u8 *src, u16 count)
+static HOT void vdp_write(u16 addr, const u8 *src, u16 count)
 {
 	set_vdp_write_address(addr);
-#if 0
+#ifdef C_KERNELS
 	do {
 		VDP_WRITE_DATA_REG = *src++;
 	} while (--count);
@@ -190,9 +291,10 @@ static void vdp_write(u16 addr, const u8 *src, u16 count)
 #endif
 }
 
-static void vdp_write8(u16 addr, const u8 *src, u16 count)
+static COLD void vdp_write8(u16 addr, const u8 *src, u16 count)
 {
-#if 0
+	vdp_next = VDP_NOWHERE;
+#ifdef C_KERNELS
 	VDP_ADDRESS_REG = addr & 0xff;
 	VDP_ADDRESS_REG = (addr | 0x4000) >> 8;
 	do {
@@ -206,32 +308,52 @@ static void vdp_write8(u16 addr, const u8 *src, u16 count)
 		VDP_WRITE_DATA_REG = *src++;
 	} while (--count);
 #else
+	ws[0] = addr + 0x4000;
+	ws[1] = (u16)src;
+	ws[2] = count;
+	asm volatile ("blwp @vdp_write8_vec" : : : "memory");
+#endif
+
+}
+
+// expand (count, byte) pairs until a zero count, with one address setup
+static COLD void vdp_unrle(u16 addr, const u8 *src)
+{
 	set_vdp_write_address(addr);
+#ifdef C_KERNELS
+	u8 count;
+	while ((count = *src++) != 0) {
+		u8 ch = *src++;
+		do {
+			VDP_WRITE_DATA_REG = ch;
+		} while (--count);
+	}
+#else
+	u16 count, ch;
 	asm volatile (
-		"1:\n\t"
-		"movb *%0+,*r15  \n\t"
-		"movb *%0+,*r15  \n\t"
-		"movb *%0+,*r15  \n\t"
-		"movb *%0+,*r15  \n\t"
-		"movb *%0+,*r15  \n\t"
-		"movb *%0+,*r15  \n\t"
-		"movb *%0+,*r15  \n\t"
-		"movb *%0+,*r15  \n\t"
-		"dec %1\n\t"
-		"jne 1b\n\t"
-		: "=r"(src),"=r"(count)
-		: "0"(src),"1"(count)
+		"clr %1  \n\t"
+		"1:  \n\t"
+		"movb *%0+,%1  \n\t"
+		"jeq 3f  \n\t"
+		"movb *%0+,%2  \n\t"
+		"2:  \n\t"
+		"movb %2,*r15  \n\t"
+		"ai %1,>FF00  \n\t"
+		"jne 2b  \n\t"
+		"jmp 1b  \n\t"
+		"3:  \n\t"
+		: "=r"(src),"=&r"(count),"=&r"(ch)
+		: "0"(src)
 	);
-
 #endif
-
 }
 
-#if 0
+#if defined(PAGE_FLIP) || defined(VDP_READ)
 static void vdp_read(u16 addr, u8 *dest, u16 count)
 {
+	vdp_next = VDP_NOWHERE;
 	VDP_ADDRESS_REG = addr & 0xff;
-	VDP_ADDRESS_REG = (addr | 0x4000) >> 8;
+	VDP_ADDRESS_REG = (addr >> 8) & 0x3f;
 	asm("nop");
 	do {
 		*dest++ = VDP_READ_DATA_REG;
@@ -244,7 +366,7 @@ static void vdp_read(u16 addr, u8 *dest, u16 count)
 
 
 
-static void init_vdp(void)
+static COLD void init_vdp(void)
 {
 	const u8 *src = vdpini;
 	u16 i;
@@ -252,6 +374,7 @@ static void init_vdp(void)
 	// initialize global register variables
 	vdp_address_reg_addr = (u8*)0x8C02;
  	vdp_write_data_reg_addr = (u8*)0x8C00;
+	vdp_next = VDP_NOWHERE;
 
 	// initialize VDP registers from table
 	for (i = 0x8000; i < 0x8800; i += 0x100) {
@@ -260,9 +383,33 @@ static void init_vdp(void)
 	}
 }
 
+static void sound_tick(void);
+static void page_flip(void);
+static u16 timer_read(void);
+#ifdef FRAME_METER
+static void frame_meter(u16 now, u8 late);
+#endif
+#ifdef EVENT_LOG
+static void event_frame(u8 late);
+#endif
+
+#define TIMER_STEP 781 // 9901 ticks per logic step, 3MHz / 64 / 60
+#define TIMER_SLACK 24 // ticks off TIMER_STEP still taken as one step, 3%
+
+// timer at the last vblank edge and the ticks since that logic_steps()
+// hasn't used up yet
+static u16 timer_last, timer_acc;
+
 static void vsync(void)
 {
+#ifdef FRAME_METER
+	u16 now = timer_read();
+#endif
+#if defined(FRAME_METER) || defined(EVENT_LOG)
+	u8 late = VDP_STATUS_REG & 0x80; // the interrupt came during the frame
+#else
 	VDP_STATUS_REG; // clear interrupt so we catch the edge
+#endif
 	asm volatile (
 		"	li r12,4\n"
 	    "	tb 0\n"
@@ -270,13 +417,38 @@ static void vsync(void)
 			::
 			:"r12");
 	VDP_STATUS_REG; // clear interrupt flag manually since we polled CRU
+	// Right at the edge, not after whatever runs below for a varying
+	// time.  A frame close to TIMER_STEP, like the 782 ticks of NTSC's
+	// 59.92Hz, counts as exactly one step, carrying the difference would
+	// add up to a two step frame every few seconds.
+	u16 t = timer_read();
+	u16 d = (timer_last - t) & 0x3fff;
+	timer_last = t;
+	if (d > TIMER_STEP - TIMER_SLACK && d < TIMER_STEP + TIMER_SLACK)
+		d = TIMER_STEP;
+	timer_acc += d;
+#ifdef FRAME_METER
+	frame_meter(now, late);
+#endif
+#ifdef EVENT_LOG
+	event_frame(late);
+#endif
+	page_flip();
+	sound_tick();
 }
 
 
 
+static u16 seed = 0xaaaa; // random() state
+
 static u16 random(void)
 {
-	static u16 seed = 0xaaaa;
+#ifdef C_KERNELS
+	if (seed & 1)
+		seed = (seed >> 1) ^ 0xb400;
+	else
+		seed >>= 1;
+#else
 	static const u16 random_mask = 0xb400;
 
 	asm volatile (
@@ -287,6 +459,7 @@ static u16 random(void)
 		: "=r"(seed)
 		: "0"(seed),"m"(random_mask)
 	);
+#endif
 	return seed;
 }
 
@@ -306,29 +479,349 @@ static u16 read_joystick(void)
 	return result;
 }
 
-#define JOYSTICK_FIRE 0x0100
-#define JOYSTICK_UP 0x1000
-#define JOYSTICK_DOWN 0x0800
-#define JOYSTICK_LEFT 0x0200
-#define JOYSTICK_RIGHT 0x0400
 
+// abs() would be a library call
+static inline s16 abs16(s16 v)
+{
+#ifdef C_KERNELS
+	if (v < 0)
+		v = -v;
+#else
+	asm ("abs %0" : "=r"(v) : "0"(v));
+#endif
+	return v;
+}
+
+// load the 9901 decrementer with its largest value and let it run, it
+// counts down once every 64 CPU cycles and wraps after 0x4000 ticks
+static void timer_start(void)
+{
+	asm volatile (
+		"clr r12  \n\t"
+		"sbo 0  \n\t"           // clock mode
+		"li r0,>7fff  \n\t"     // bit 0 keeps clock mode, bits 1-14 the start value
+		"ldcr r0,15  \n\t"
+		"sbz 0  \n\t"
+		: : : "r0", "r12"
+	);
+	timer_last = timer_read();
+	timer_acc = 0;
+}
+
+static u16 timer_read(void)
+{
+	u16 t;
+	asm volatile (
+		"clr r12  \n\t"
+		"sbo 0  \n\t"
+		"stcr %0,15  \n\t"
+		"sbz 0  \n\t"
+		: "=r"(t) : : "r12"
+	);
+	return (t >> 1) & 0x3fff;
+}
+
+#define MAX_STEPS 3    // logic steps caught up in one frame at most
+
+// Number of logic steps due since the last call, from the ticks vsync()
+// latched.  The game logic runs at 60 steps a second whatever the video
+// refresh is, a 50Hz console gets two steps every fifth frame and a frame
+// that overran gets the one it missed.
+static u16 logic_steps(void)
+{
+	u16 steps = 0;
+
+	while (timer_acc >= TIMER_STEP) {
+		timer_acc -= TIMER_STEP;
+		steps++;
+	}
+	return steps < MAX_STEPS ? steps : MAX_STEPS;
+}
+
+// forget the time logic_steps() wasn't called for, the rainbow's frames
+// or loading a level, instead of catching up on it
+static void logic_steps_reset(void)
+{
+	timer_last = timer_read();
+	timer_acc = 0;
+}
 
 
 
-// linker seems to want this even though unused
+// Also what gcc calls for struct copies.  A word at a time where the
+// pointers allow, with a byte before and after for odd ends.
 void memcpy(void *dst, void *src, unsigned int count)
 {
 	char *a = dst, *b = src;
+
+	if ((((u16)a ^ (u16)b) & 1) == 0 && count > 1) {
+		if ((u16)a & 1) {
+			*a++ = *b++;
+			count--;
+		}
+		u16 n = count >> 1;
+		count &= 1;
+		if (n) {
+#ifdef C_KERNELS
+			do {
+				*(u16 *)a = *(u16 *)b;
+				a += 2;
+				b += 2;
+			} while (--n);
+#else
+			asm volatile (
+				"1:  \n\t"
+				"mov *%1+,*%0+  \n\t"
+				"dec %2  \n\t"
+				"jne 1b  \n\t"
+				: "=r"(a),"=r"(b),"=r"(n)
+				: "0"(a),"1"(b),"2"(n)
+				: "memory"
+			);
+#endif
+		}
+	}
 	while (count--)
 		*a++ = *b++;
 }
+
 void memset(void *dst, char byte, unsigned int count)
 {
 	char *a = dst;
+
+	if (count > 1) {
+		if ((u16)a & 1) {
+			*a++ = byte;
+			count--;
+		}
+		u16 n = count >> 1;
+		u16 w = (u8)byte * 0x101;
+		count &= 1;
+		if (n) {
+#ifdef C_KERNELS
+			do {
+				*(u16 *)a = w;
+				a += 2;
+			} while (--n);
+#else
+			asm volatile (
+				"1:  \n\t"
+				"mov %2,*%0+  \n\t"
+				"dec %1  \n\t"
+				"jne 1b  \n\t"
+				: "=r"(a),"=r"(n)
+				: "r"(w),"0"(a),"1"(n)
+				: "memory"
+			);
+#endif
+		}
+	}
 	while (count--)
 		*a++ = byte;
 }
 
+// load and run addresses of the overlays, from the linker script
+extern char __load_start_ovl_init[], __load_stop_ovl_init[], __run_ovl_init[];
+extern char __load_start_ovl_level[], __load_stop_ovl_level[], __run_ovl_level[];
+
+static u8 ovl_current; // overlay in the overlay region
+
+static COLD void ovl_load(u8 n)
+{
+	static char *const ovl[][3] = {
+		{__load_start_ovl_init, __load_stop_ovl_init, __run_ovl_init},
+		{__load_start_ovl_level, __load_stop_ovl_level, __run_ovl_level},
+	};
+
+	if (n == ovl_current)
+		return;
+	ovl_current = n;
+	char *const *o = ovl[n-1];
+	if (o[0] != o[2]) // not run in place
+		memcpy(o[2], o[0], o[1] - o[0]);
+}
+
+#elif defined(HOST)
+// Host build used by soak.c.  VRAM is an array, VDP and sound chip
+// traffic is counted per frame, and the frame and joystick hooks are
+// supplied by the runner.
+
+#include <stdlib.h>
+#include <string.h>
+
+#define random turmoil_random
+#define C_KERNELS // no asm, the shared code takes its C
+
+static u8 vram[0x4000];
+static u16 vdp_addr;
+static u8 snd_latch;
+
+static struct {
+	u16 bytes; // VDP data bytes
+	u16 setups; // VDP address setups
+	u16 skipped; // setups vdp_seek() left out
+	u16 lost; // of those, the ones where the VDP was somewhere else
+	u16 sound; // sound chip writes
+} traffic;
+static u16 vdp_next = VDP_NOWHERE;
+
+static u8 *host_vdp_data(void)
+{
+	traffic.bytes++;
+	return &vram[vdp_addr++ & 0x3fff];
+}
+
+static u8 *host_snd(void)
+{
+	traffic.sound++;
+	return &snd_latch;
+}
+
+#define VDP_WRITE_DATA_REG  (*host_vdp_data())
+#define SND_REG             (*host_snd())
+
+static inline void set_vdp_write_address(u16 addr)
+{
+	traffic.setups++;
+	vdp_addr = addr;
+	vdp_next = VDP_NOWHERE;
+}
+
+// as on the console, and checked against where the VDP really is
+static inline void vdp_seek(u16 addr, u8 n)
+{
+	if (addr != vdp_next) {
+		traffic.setups++;
+	} else {
+		traffic.skipped++;
+		if ((vdp_addr & 0x3fff) != addr)
+			traffic.lost++;
+	}
+	vdp_addr = addr;
+	vdp_next = addr + n;
+}
+
+static u8 vdp_regs[8];
+
+static inline void vdp_reg(u8 reg, u8 val)
+{
+	traffic.setups++;
+	vdp_next = VDP_NOWHERE;
+	vdp_regs[reg] = val;
+}
+
+static void vdp_memset(u16 addr, u8 ch, u16 count)
+{
+	set_vdp_write_address(addr);
+	do {
+		VDP_WRITE_DATA_REG = ch;
+	} while (--count);
+}
+
+static void vdp_write(u16 addr, const u8 *src, u16 count)
+{
+	set_vdp_write_address(addr);
+	do {
+		VDP_WRITE_DATA_REG = *src++;
+	} while (--count);
+}
+
+static void vdp_write8(u16 addr, const u8 *src, u16 count)
+{
+	vdp_write(addr, src, count * 8);
+}
+
+static void vdp_unrle(u16 addr, const u8 *src)
+{
+	u8 count;
+	set_vdp_write_address(addr);
+	while ((count = *src++) != 0) {
+		u8 ch = *src++;
+		do {
+			VDP_WRITE_DATA_REG = ch;
+		} while (--count);
+	}
+}
+
+#ifdef PAGE_FLIP
+static void vdp_read(u16 addr, u8 *dest, u16 count)
+{
+	traffic.setups++;
+	vdp_next = VDP_NOWHERE;
+	traffic.bytes += count;
+	memcpy(dest, &vram[addr & 0x3fff], count);
+}
+#endif
+
+static void init_vdp(void)
+{
+	memcpy(vdp_regs, vdpini, sizeof(vdp_regs));
+}
+
+static void host_frame(void);
+static u16 host_joystick(void);
+#ifdef RECORD
+static u16 host_attract(void);
+#endif
+static void sound_tick(void);
+static void page_flip(void);
+#ifdef EVENT_LOG
+static void event_frame(u8 late);
+#endif
+
+static void vsync(void)
+{
+#ifdef EVENT_LOG
+	event_frame(0);
+#endif
+	page_flip();
+	host_frame();
+	sound_tick();
+}
+
+static u16 seed = 0xaaaa; // random() state
+
+static u16 random(void)
+{
+	if (seed & 1)
+		seed = (seed >> 1) ^ 0xb400;
+	else
+		seed >>= 1;
+	return seed;
+}
+
+static u16 read_joystick(void)
+{
+	return host_joystick();
+}
+
+static inline s16 abs16(s16 v)
+{
+	return v < 0 ? -v : v;
+}
+
+// one logic step per frame keeps the runners deterministic
+static void timer_start(void)
+{
+}
+
+static u16 logic_steps(void)
+{
+	return 1;
+}
+
+static void logic_steps_reset(void)
+{
+}
+
+static u16 start_level = 1; // set by the runner
+#define START_LEVEL start_level
+
+static void ovl_load(u8 n)
+{
+	(void)n;
+}
+
 #else
 #error Compiler target not supported
 
@@ -336,6 +829,127 @@ void memset(void *dst, char byte, unsigned int count)
 
 #endif
 
+// first level of a game, "make turmoil_level9.bin" starts on level 9
+#ifndef START_LEVEL
+#define START_LEVEL 1
+#endif
+
+#ifdef PAGE_FLIP
+// Double buffered playfield.  During a frame the name table and sprite
+// list writes go to the hidden pair, vsync() shows it by pointing VDP
+// registers 2 and 5 at it and page_flip() copies what was written into
+// the other pair, which is hidden from then on.  What was written is kept
+// as a span of columns for each playfield row, the score line and the
+// sprite list, in units of two columns or two sprites so a span fits a
+// byte of scratchpad.
+#define SCRTAB2 0x3C00 // Second screen table, over sprite patterns 32-55
+#define SPRTAB2 0x1B00 // Second sprite list table, after SCRTAB, see spr_off
+#define PAGE_SPR 8     // the sprite list span, 0-6 are rows and 7 the score
+
+static u16 scr_off = SCRTAB2 - SCRTAB; // hidden page, added to SCRTAB addresses
+#define spr_off ((u16)-(scr_off >> 3)) // and to SPRTAB addresses, SPRTAB2 is placed for it
+static u8 dirty[9]; // spans written this frame, first unit << 4 | last, empty if first > last
+
+// name table line to its span
+static const u8 scr_slot[24] = {
+	7, 7, 7, 0, 0, 0, 1, 1, 1, 2, 2, 2,
+	3, 3, 3, 4, 4, 4, 5, 5, 5, 6, 6, 6,
+};
+
+static HOT void page_dirty(u16 addr, u8 n)
+{
+	u8 slot, lo, hi;
+
+	if (addr >= SPRTAB) {
+		slot = PAGE_SPR;
+		lo = (addr - SPRTAB) >> 3;
+		hi = (addr - SPRTAB + n - 1) >> 3;
+	} else {
+		slot = scr_slot[(addr - SCRTAB) >> 5];
+		lo = (addr & 31) >> 1;
+		hi = ((addr & 31) + n - 1) >> 1;
+		if (hi > 15)
+			hi = 15; // ran into the next line, which isn't copied
+	}
+	u8 d = dirty[slot];
+	if (lo < (d >> 4))
+		d = (d & 0x0f) | (lo << 4);
+	if (hi > (d & 0x0f))
+		d = (d & 0xf0) | hi;
+	dirty[slot] = d;
+}
+
+static void page_clean(void)
+{
+	memset(dirty, 0xf0, sizeof(dirty));
+}
+
+// exchange which pages the writes go to
+static void page_swap(void)
+{
+	scr_off ^= SCRTAB2 - SCRTAB;
+}
+
+// show the first pair again and draw into the second
+static void page_reset(void)
+{
+	if (scr_off == 0)
+		page_swap();
+	vdp_reg(5, SPRTAB/0x80);
+	page_clean();
+}
+
+// draw() a whole screen update into both pages, outside the frame loop
+static void both_pages(void (*draw)(void))
+{
+	draw();
+	page_swap();
+	draw();
+	page_swap();
+	page_clean();
+}
+
+// set the write address for n name table bytes in the hidden page
+static inline void set_scr_address(u16 addr, u8 n)
+{
+	page_dirty(addr, n);
+	vdp_seek(addr + scr_off, n);
+}
+
+// set the write address for a sprite in the hidden sprite list
+static inline void set_spr_address(u16 addr)
+{
+	page_dirty(addr & ~3, 4);
+	set_vdp_write_address(addr + spr_off);
+}
+
+#define SCR(addr) ((addr) + scr_off)
+#define SPR(addr) ((addr) + spr_off)
+#else
+static inline void set_scr_address(u16 addr, u8 n)
+{
+	vdp_seek(addr, n);
+}
+
+static inline void set_spr_address(u16 addr)
+{
+	set_vdp_write_address(addr);
+}
+
+#define SCR(addr) (addr)
+#define SPR(addr) (addr)
+#define both_pages(draw) draw()
+#define page_reset()
+static inline void page_flip(void)
+{
+}
+#endif
+
+#define JOYSTICK_FIRE 0x0100
+#define JOYSTICK_UP 0x1000
+#define JOYSTICK_DOWN 0x0800
+#define JOYSTICK_LEFT 0x0200
+#define JOYSTICK_RIGHT 0x0400
 
 
 
@@ -389,7 +1003,7 @@ static const u8 sh[] = {34, 36, 38, 35, 37, 39};
 
 static const u8 ex[] = {32, 0x80, 0x82, 0x84, 32, 0x81, 0x83, 0x85, 32};
 
-static void shifted_bg(u16 i, u8 base, const u8 *pal)
+static COLD OVERLAY(init) void shifted_bg(u16 i, u8 base, const u8 *pal)
 {
 	for (u16 j = 0; j < 8; j++) {
 		vdp_memset(PATTAB+i+(base+j)*8, 0xff >> j, 8);
@@ -404,15 +1018,36 @@ static void shifted_bg(u16 i, u8 base, const u8 *pal)
 	}
 }
 
-static void setup(void)
+#ifdef BAND_BULLETS
+// The bullet's red line on the upper char row of a lane, shifted in and
+// out like the bands of shifted_bg().  The other lines are black on black.
+static COLD OVERLAY(init) void bullet_bg(u16 i)
+{
+	static const u8 pal[] = {0x11,0x11,0x11,0x11,0x11,0x11,0x11,0x61};
+
+	for (u16 j = 0; j < 8; j++) {
+		vdp_memset(PATTAB+i+(BULLET_CH+j)*8, 0xff >> j, 8);
+		vdp_memset(PATTAB+i+(BULLET_CH+8+j)*8, 0xff00 >> j, 8);
+		vdp_write(CLRTAB+i+(BULLET_CH+j)*8, pal, 8);
+		vdp_write(CLRTAB+i+(BULLET_CH+8+j)*8, pal, 8);
+	}
+}
+#endif
+
+static COLD OVERLAY(init) void setup(void)
 {
 	// clear the screen
 	vdp_memset(SCRTAB, ' ', 32 * 24);
 
+	// number and sprite patterns, everything in assets.txt with a VRAM address
+	for (u16 n = 0; n < sizeof(asset_index)/sizeof(asset_index[0]); n++) {
+		if (asset_index[n].vram != ASSET_NO_VRAM)
+			vdp_write8(asset_index[n].vram, asset(n), asset_index[n].length/8);
+	}
+
 	// initialize each VDP bank chars
 	for (u16 i = 0; i < 0x1800; i += 0x800) {
-		// numbers
-		vdp_write(PATTAB+i+'0'*8, number_ch, 8*10);
+		// number colors
 		vdp_memset(CLRTAB+i+'0'*8, 0xf1, 8*10);
 
 		// wall color and pattern
@@ -426,20 +1061,34 @@ static void setup(void)
 		shifted_bg(i, 0xa0, explode_pal);
 		shifted_bg(i, 0xc0, enemy_pal);
 		shifted_bg(i, 0xe0, arrow_pal);
+#ifdef BAND_BULLETS
+		bullet_bg(i);
+#endif
 	}	
-	
-	// load sprite patterns
-	vdp_write8(SPRPAT, sprite_pat, sizeof(sprite_pat)/8);
 
 	// get ship sprite into char[0..3]
 	set_vdp_write_address(PATTAB);
 	for (u16 i = 0 ; i < 32; i++) {
-		VDP_WRITE_DATA_REG = ~sprite_pat[2*32+i];
+		VDP_WRITE_DATA_REG = ~asset(ASSET_SPRITE_PAT)[2*32+i];
 	}
 	vdp_write8(CLRTAB, ship_pal, 1);
 	vdp_write8(CLRTAB+8, ship_pal+8, 1);
 	vdp_write8(CLRTAB+16, ship_pal, 1);
 	vdp_write8(CLRTAB+24, ship_pal+8, 1);
+
+	// rainbow screen between levels, shown by pointing VDP register 2
+	// at it so the playfield can be drawn behind it
+	static const u8 row[32] = "AAaaAAAaaaAAaAaaaaAaAAaaaAAAaaAA";
+
+	set_vdp_write_address(RBWTAB);
+	for (u16 j = 0; j < 24; j++) {
+		for (u16 i = 0; i < 32; i++) {
+			VDP_WRITE_DATA_REG = row[i]+(j&7);
+		}
+	}
+	vdp_memset(RBWTAB + 32*10 + 13, 0, 6);
+	vdp_memset(RBWTAB + 32*11 + 13, 0, 6);
+	vdp_memset(RBWTAB + 32*12 + 13, 0, 6);
 }
 
 
@@ -462,8 +1111,7 @@ enum {
 	BALL,
 	TANK,
 	EXPLODE,
-
-} enemy_types;
+};
 
 static const struct {
 	u8 base, mask, score;
@@ -483,28 +1131,134 @@ static const struct {
 	{16, 12, 0}, // EXPLODE
 };
 
+#ifdef SOFT_ENEMIES
+// Enemies that are drawn in the name table instead of with a sprite, which
+// frees their sprite slot.  Each one is pre-shifted from its sprite artwork
+// to four positions two pixels apart, six chars (3x2) per position, and the
+// chars left free in each bank hold three of them.  Only enemies without
+// animation or direction frames fit.
+static const struct {
+	u8 type;
+	const u8 *pal;
+	u8 ch[4]; // first char for each position
+} soft_enemy[] = {
+	{HOTDOG, enemy_pal, {0x04, 0x0a, 0x10, 0x16}},
+	{SAUCER, arrow_pal, {0x22, 0x28, 0x3a, 0x49}},
+	{BALL, enemy_pal, {0x4f, 0x55, 0x5b, 0x69}},
+};
+
+// soft_enemy[] index + 1 by enemy type, 0 if drawn with a sprite
+static const u8 soft_idx[] = {0, 0, 0, 1, 0, 0, 0, 0, 2, 3, 0, 0};
+
+// Pre-shift the soft enemies into each bank, the band with the enemy
+// shape cut out of it.  The left char is the band shifted in as in
+// shifted_bg(), the middle char full and the right char shifted out.
+static COLD OVERLAY(init) void soft_tiles(void)
+{
+	for (u16 n = 0; n < sizeof(soft_enemy)/sizeof(soft_enemy[0]); n++) {
+		const u8 *pat = asset(ASSET_SPRITE_PAT) + spridx[soft_enemy[n].type].base * 8;
+		const u8 *pal = soft_enemy[n].pal;
+
+		for (u16 k = 0; k < 4; k++) {
+			u8 s = k * 2;
+			u16 ch = soft_enemy[n].ch[k] * 8;
+			for (u16 i = 0; i < 0x1800; i += 0x800) {
+				// computed again for each bank rather than kept in a
+				// buffer, the stack has little room in scratchpad
+				set_vdp_write_address(PATTAB+i+ch);
+				for (u16 h = 0; h < 16; h += 8) {
+					for (u16 c = 0; c < 3; c++) {
+						for (u16 y = h; y < h + 8; y++) {
+							u8 hi = pat[y], lo = pat[16+y];
+							VDP_WRITE_DATA_REG =
+								c == 0 ? (0xff >> s) & ~(hi >> s) :
+								c == 1 ? ~((hi << (8 - s)) | (lo >> s)) :
+								(0xff00 >> s) & ~(lo << (8 - s));
+						}
+					}
+				}
+				for (u16 j = 0; j < 3; j++) {
+					vdp_write(CLRTAB+i+ch+j*8, pal, 8);
+					vdp_write(CLRTAB+i+ch+24+j*8, pal+8, 8);
+				}
+			}
+		}
+	}
+}
+#endif
+
+// Enemy speeds as ready-to-add deltas for enemy[].dx, in 8.8 fixed point
+// pixels per step.  SPEED() converts from the 4.4 fixed point pixels the
+// game was tuned in.  Levels 6 to 9 use the second set, where spawned
+// enemies and saucers are twice as fast.  A different difficulty curve is
+// another set and its entries in level_speed[].  Tanks and balls have a
+// curve of their own, level_tank[] and level_ball[].
+#define SPEED(v) ((v) * 16)
+#define SPEED_SET(m) { \
+	{ \
+		SPEED(5*m), SPEED(6*m), SPEED(7*m), SPEED(8*m), \
+		SPEED(9*m), SPEED(10*m), SPEED(11*m), SPEED(12*m), \
+		SPEED(13*m), SPEED(14*m), SPEED(15*m), SPEED(16*m), \
+		SPEED(17*m), SPEED(18*m), SPEED(19*m), SPEED(20*m), \
+	}, \
+	SPEED(20*m), SPEED(15*m), SPEED(32), \
+}
+
+static const struct speeds {
+	s16 spawn[16]; // picked by random() & 15
+	s16 arrow;
+	s16 saucer;
+	s16 explode;
+} speeds[] = {
+	SPEED_SET(1),
+	SPEED_SET(2),
+};
+
+static const u8 level_speed[10] = { 0, 0, 0, 0, 0, 0, 1, 1, 1, 1 };
+
+// Tanks (arrows turned around at the edge) and balls (prizes that weren't
+// collected) get a little faster every level, from the speeds level 1
+// was tuned with.
+static const s16 level_tank[10] = {
+	0, SPEED(25), SPEED(26), SPEED(27), SPEED(28),
+	SPEED(29), SPEED(31), SPEED(33), SPEED(35), SPEED(37),
+};
+static const s16 level_ball[10] = {
+	0, SPEED(102), SPEED(104), SPEED(106), SPEED(108),
+	SPEED(110), SPEED(114), SPEED(118), SPEED(122), SPEED(126),
+};
+
+#define LEVEL_SPEEDS (&speeds[level_speed[level]])
+
+// Levels that draw slow enemies away from the ship on alternate frames
+// only, see main().  Their logic still runs every step, the chars and
+// sprite catch up with two frames of movement at once.
+static const u8 level_lod[10] = { 0, 0, 0, 0, 0, 0, 1, 1, 1, 1 };
+#define LOD_FAST SPEED(32) // balls and explosions are always drawn
+static u8 lod_frame; // toggled every frame, which half of the rows waits
+
 // enemies have 
-//   speed and direction: signed 4.4 fixed point range -7.F to +7.F
-//   x position unsigned 8.4 fixed point 0.0 to 240.0
+//   speed and direction: signed 8.8 fixed point delta added every step
+//   x position unsigned 8.8 fixed point 0.0 to 240.0
 //   y position is implied by enemy number
-//   type is 0 to 15, store in low bits of x position
 static struct {
 	u16 x; // horizontal pos in pixels, 8.8 fixed point
-	s8 v; // velocity in pixels (direction and speed) 4.4 fixed point
+	s16 dx; // added to x every step, 0 for a waiting saucer or prize
 	u8 type; // enemy type 0..12
+	u8 drawn; // pixel x of the chars on screen, see main()
 } enemy[7] = {
 #if 0
-	{0x0100, 20, TANK},
-	{0xf000, -102, BALL},
-	{0x0100, 10, 3},
-	{0x0100, 1, 4},
-	{0xf100, -1, 5},
-	{0x0100, 5, 6},
-	{0xf000, -20, ARROW},
+	{0x0100, SPEED(20), TANK},
+	{0xf000, -SPEED(102), BALL},
+	{0x0100, SPEED(10), 3},
+	{0x0100, SPEED(1), 4},
+	{0xf100, -SPEED(1), 5},
+	{0x0100, SPEED(5), 6},
+	{0xf000, -SPEED(20), ARROW},
 #endif
 };
 	// up to seven bullets, direction determined by position relative to center
-static u16 bullet[7]; // unsigned 8.4 fixed point, moves by 6.4 pixels/frame
+static u16 bullet[7]; // unsigned 8.4 fixed point, moves by 6.4 pixels/step
 static struct {
 	u8 dir; // right=0 or left=1
 	u8 move;
@@ -529,9 +1283,65 @@ u16
 u8 	demo = 1,
 	wcount = 0;  // wall counter
 
+static const u8 *replay; // attract mode recording position, 0 if not replaying
+static u8
+	replay_count, // frames left of the current joystick value
+	replay_bad; // recording didn't play out as recorded
+
+// Debug build that keeps the last 64 game events (turmoil_events.bin), so
+// a frame that hitched can be matched with what happened in it.  Each is
+// two words, the frame it happened in and kind << 12 | row << 8 | arg,
+// oldest first from events.head.  The cartridge keeps them at >3EFC, the
+// top of lower expansion RAM that neither build uses, where an emulator's
+// debugger can dump them; soak.c decodes them on the host.
+#ifdef EVENT_LOG
+enum {
+	EV_NONE,
+	EV_SPAWN, // arg enemy type
+	EV_KILL, // arg enemy type shot
+	EV_PUSH, // tank pushed back, arg its new x
+	EV_PRIZE, // prize collected
+	EV_SAUCER, // saucer launched, arg its x
+	EV_SHIP, // ship lost, arg ships left
+	EV_OVERRUN, // the frame missed its vsync
+	EV_LEVEL, // rainbow to the next level, arg level
+};
+
+#define EVENT_LOG_SIZE 64 // a power of 2
+
+struct event_log {
+	u16 head; // next slot, in words
+	u16 frame; // vsync() calls since power up
+	u16 ring[EVENT_LOG_SIZE * 2];
+};
+
+#ifdef tms9900
+#define events (*(struct event_log *)0x3EFC) // up to >4000
+#else
+static struct event_log events;
+#endif
+
+static void event_log(u16 what)
+{
+	u16 *e = &events.ring[events.head];
+	e[0] = events.frame;
+	e[1] = what;
+	events.head = (events.head + 2) & (EVENT_LOG_SIZE * 2 - 1);
+}
+
+#define event(kind, row, arg) event_log((kind) << 12 | (row) << 8 | (u8)(arg))
+
+// called by vsync() at the end of every frame
+static void event_frame(u8 late)
+{
+	if (late)
+		event(EV_OVERRUN, 0, 0);
+	events.frame++;
+}
+#else
+#define event(kind, row, arg)
+#endif
 
-static const u16 *sound = (u16*)0;
-static const u8 *noise = (u8*)0;
 
 #define STEP6(t1,v1,t2,v2) \
 	(((((u32)t1*6+(u32)t2*0)/6)&0xfff0) | (v1*6+v2*0)/6), \
@@ -560,93 +1370,198 @@ static const u16 sound_ball[] = {0x0823,0x0812,0x0803,0x080f};
 static const u16 sound_saucer[] = {STEP9(0x1000,0,0x0100,4),0x010f};
 static const u8 noise_spawn[] = {0xe6, STEP9(0xf0,10,0xf0,0), 0xff};
 
-static void play_sounds(void)
-{
-	if (sound) {
-		u16 s = *sound++;
-		// 10 bits frequency divider
-		// 4 bits attenuator
-		SND_REG = 0xc0 | ((s >> 4) & 0xf);
-		SND_REG = (s >> 8);
-		SND_REG = 0xd0 | (s & 0xf);
-		if ((s & 0xf) == 0xf)
-			sound = 0;
-	}
-	if (noise) {
-		u8 n = *noise++;
-		SND_REG = n;
-		if (n == 0xff)
-			noise = 0;
-	}
-}
-
-
+// sound priorities, a new sound takes the voice playing the least
+// important one, so a shot never cuts off the saucer
+enum {
+	PRIO_IDLE,
+	PRIO_MOVE,
+	PRIO_SHOOT,
+	PRIO_BALL,
+	PRIO_SAUCER,
+	PRIO_DEATH,
+};
 
+// three tone voices stepped once per frame from vsync(), the asm
+// sound_tick() names both structs
+static struct {
+	const u16 *data; // 10 bits frequency divider, 4 bits attenuator
+	u16 last; // value last written to the chip
+	u8 prio;
+	u8 rate; // frames per step
+	u8 wait; // frames until next step
+} voice[3] __attribute__((used));
 
+static struct {
+	const u8 *data; // noise control and attenuator bytes
+	u8 last;
+	u8 rate;
+	u8 wait;
+} noise __attribute__((used));
 
+static void sound_play(const u16 *data, u8 prio, u8 rate)
+{
+	u16 i, v = 0;
+
+	if (demo || replay)
+		return;
+	for (i = 0; i < 3; i++) {
+		if (voice[i].prio == prio) {
+			// restart the same kind of sound in place
+			v = i;
+			break;
+		}
+		if (voice[i].prio < voice[v].prio)
+			v = i;
+	}
+	if (voice[v].prio > prio)
+		return;
+	voice[v].data = data;
+	voice[v].prio = prio;
+	voice[v].rate = rate;
+	voice[v].wait = 1;
+}
 
+static void noise_play(const u8 *data, u8 rate)
+{
+	if (demo || replay)
+		return;
+	noise.data = data;
+	noise.rate = rate;
+	noise.wait = 1;
+}
 
-static void rainbow(void)
+// silence everything and forget what the chip holds
+static void sound_stop(void)
 {
-	const u8 row[32] = "AAaaAAAaaaAAaAaaaaAaAAaaaAAAaaAA";
+	for (u16 i = 0; i < 3; i++) {
+		voice[i].data = 0;
+		voice[i].prio = PRIO_IDLE;
+		voice[i].last = 0xffff;
+		SND_REG = 0x9f | (i << 5);
+	}
+	noise.data = 0;
+	noise.last = 0xff;
+	SND_REG = 0xff;
+}
 
-	vdp_memset(SPRTAB, 0xd0, 1); // sprite list terminator
+#ifndef C_KERNELS
+// struct offsets used by sound_tick_ws
+//   voice: 0 data, 2 last, 4 prio, 5 rate, 6 wait, 8 bytes each
+//   noise: 0 data, 2 last, 3 rate, 4 wait
+asm(
+	"	.pushsection .text\n"
+	"sound_tick_vec:\n"
+	"	data ws, sound_tick_ws\n"
+	"sound_tick_ws:\n"
+	"	li r2,voice\n"
+	"	li r9,>8000\n"		// tone latch, channel in bits 6,5
+	"	li r10,3\n"
+	"1:	mov *r2,r7\n"
+	"	jeq 4f\n"
+	"	sb r5,@6(r2)\n"	// --wait
+	"	jne 4f\n"
+	"	movb @5(r2),@6(r2)\n"
+	"	mov *r7+,r0\n"
+	"	mov r7,*r2\n"
+	"	mov r0,r1\n"
+	"	xor @2(r2),r1\n"	// changed bits
+	"	mov r0,@2(r2)\n"
+	"	mov r1,r8\n"
+	"	andi r8,>fff0\n"
+	"	jeq 2f\n"
+	"	mov r0,r8\n"
+	"	sla r8,4\n"
+	"	andi r8,>0f00\n"
+	"	soc r9,r8\n"
+	"	movb r8,*r6\n"		// frequency low 4 bits
+	"	movb r0,*r6\n"		// frequency high 6 bits
+	"2:	andi r1,>000f\n"
+	"	jeq 3f\n"
+	"	mov r0,r8\n"
+	"	swpb r8\n"
+	"	andi r8,>0f00\n"
+	"	soc r9,r8\n"
+	"	ori r8,>1000\n"
+	"	movb r8,*r6\n"		// attenuator
+	"3:	inv r0\n"
+	"	andi r0,>000f\n"
+	"	jne 4f\n"
+	"	clr *r2\n"		// silent, voice is free
+	"	sb @4(r2),@4(r2)\n"
+	"4:	ai r2,8\n"
+	"	ai r9,>2000\n"
+	"	dec r10\n"
+	"	jne 1b\n"
+	"	li r2,noise\n"
+	"	mov *r2,r7\n"
+	"	jeq 6f\n"
+	"	sb r5,@4(r2)\n"
+	"	jne 6f\n"
+	"	movb @3(r2),@4(r2)\n"
+	"	movb *r7+,r0\n"
+	"	mov r7,*r2\n"
+	"	cb r0,@2(r2)\n"
+	"	jeq 5f\n"
+	"	movb r0,*r6\n"
+	"	movb r0,@2(r2)\n"
+	"5:	seto r8\n"
+	"	cb r0,r8\n"
+	"	jne 6f\n"
+	"	clr *r2\n"
+	"6:	rtwp\n"
+	"	.popsection\n"
+);
+#endif
 
-	set_vdp_write_address(SCRTAB+32*0);
-	for (u16 j = 0; j < 24; j++) {
-		for (u16 i = 0; i < 32; i++) {
-			VDP_WRITE_DATA_REG = row[i]+(j&7);
+// only the frequency or attenuator bytes that changed are written
+static HOT void sound_tick(void)
+{
+#ifdef C_KERNELS
+	for (u16 i = 0; i < 3; i++) {
+		if (!voice[i].data || --voice[i].wait)
+			continue;
+		voice[i].wait = voice[i].rate;
+		u16 s = *voice[i].data++;
+		u16 d = s ^ voice[i].last;
+		u8 ch = i << 5;
+		if (d & 0xfff0) {
+			SND_REG = 0x80 | ch | ((s >> 4) & 0xf);
+			SND_REG = (s >> 8);
+		}
+		if (d & 0xf)
+			SND_REG = 0x90 | ch | (s & 0xf);
+		voice[i].last = s;
+		if ((s & 0xf) == 0xf) {
+			voice[i].data = 0;
+			voice[i].prio = PRIO_IDLE;
 		}
 	}
-	//for (u16 j = 20; j < 24; j++) {
-	//	vdp_memset(SCRTAB + 32*j, ' ', 32);
-	//}
+	if (noise.data && !--noise.wait) {
+		noise.wait = noise.rate;
+		u8 n = *noise.data++;
+		if (n != noise.last)
+			SND_REG = n;
+		noise.last = n;
+		if (n == 0xff)
+			noise.data = 0;
+	}
+#else
+	asm volatile ("blwp @sound_tick_vec" : : : "memory");
+#endif
+}
+
+
 
-	vdp_memset(SCRTAB + 32*10 + 13, 0, 6);
-	vdp_memset(SCRTAB + 32*11 + 13, 0, 6);
-	vdp_memset(SCRTAB + 32*11 + 16, level+'0', 1);
-	vdp_memset(SCRTAB + 32*12 + 13, 0, 6);
 
-#define OFF1 88
-#define OFF2 0
 
-	SND_REG = 0xd2;
-	SND_REG = 0xff;
-	for (u16 i = 0; i < 256; i++) {
-		u8 off = 0;
-		u16 s = 0x400 - ((i & 0xf0)*3 + (i & 0xf)*16);
-		SND_REG = 0xc0 | (s & 0xf);
-		SND_REG = s >> 4;
-		for (u16 j = 0; j < 0x1800; j += 0x800) {
-			vdp_write8(PATTAB+j + 'A'*8, rainbow_ch+((OFF2-i+off) & 0xff), 8);
-			vdp_write8(CLRTAB+j + 'A'*8, rainbow_co+((OFF2-i+off) & 0xff), 8);
-			vdp_write8(PATTAB+j + 'a'*8, rainbow_ch+((OFF1+i+off) & 0xff), 8);
-			vdp_write8(CLRTAB+j + 'a'*8, rainbow_co+((OFF1+i+off) & 0xff), 8);
-			off += 64;
-		}
-#if 0
-		vdp_write8(PATTAB2 + 'A'*8, rainbow_ch+((OFF2-i+64) & 0xff), 8);
-		vdp_write8(CLRTAB2 + 'A'*8, rainbow_co+((OFF2-i+64) & 0xff), 8);
-		vdp_write8(PATTAB2 + 'a'*8, rainbow_ch+((OFF1+i+64) & 0xff), 8);
-		vdp_write8(CLRTAB2 + 'a'*8, rainbow_co+((OFF1+i+64) & 0xff), 8);
-
-		vdp_write8(PATTAB3 + 'A'*8, rainbow_ch+((OFF2-i+64+64) & 0xff), 8);
-		vdp_write8(CLRTAB3 + 'A'*8, rainbow_co+((OFF2-i+64+64) & 0xff), 8);
-		vdp_write8(PATTAB3 + 'a'*8, rainbow_ch+((OFF1+i+64+64) & 0xff), 8);
-		vdp_write8(CLRTAB3 + 'a'*8, rainbow_co+((OFF1+i+64+64) & 0xff), 8);
-#endif
-		vsync();
-	}
-	SND_REG = 0xdf;
-	SND_REG = 0xff;	
-}
 
-static void draw_score(void)
+// the score, or the high score while the attract mode replays
+static COLD void draw_score(void)
 {
-	u16 places[] = {10000,1000,100,10,1};
+	static const u16 places[] = {10000,1000,100,10,1};
 	u8 digit;
-	u16 i,j = score;
-	set_vdp_write_address(SCRTAB + 18);
+	u16 i,j = replay ? hiscore : score;
+	set_scr_address(SCRTAB + 18, 6);
 	for (i = 0; i < 5; i++) {
 		digit = '0';
 		while (j >= places[i]) {
@@ -658,28 +1573,25 @@ static void draw_score(void)
 	VDP_WRITE_DATA_REG = '0';
 }
 
-static void draw_ships(void)
+// the spare ships, a char row at a time so the VDP address runs on
+static COLD void draw_ships(void)
 {
-	u16 i, addr = SCRTAB;
-	u16 a = 0x0002, b = 0x0103;
+	u16 i;
 	for (i = 0; i < 6; i++) {
-		if (i == ships) {
-			a = 0x2020;
-			b = 0x2020;
-		}
-		set_vdp_write_address(addr);
-		VDP_WRITE_DATA_REG = a >> 8;
-		VDP_WRITE_DATA_REG = a & 0xff;
+		set_scr_address(SCRTAB + i*3, 3);
+		VDP_WRITE_DATA_REG = i < ships ? 0 : ' ';
+		VDP_WRITE_DATA_REG = i < ships ? 2 : ' ';
 		VDP_WRITE_DATA_REG = ' ';
-		set_vdp_write_address(addr+32);
-		VDP_WRITE_DATA_REG = b >> 8;
-		VDP_WRITE_DATA_REG = b & 0xff;
+	}
+	for (i = 0; i < 6; i++) {
+		set_scr_address(SCRTAB+32 + i*3, 3);
+		VDP_WRITE_DATA_REG = i < ships ? 1 : ' ';
+		VDP_WRITE_DATA_REG = i < ships ? 3 : ' ';
 		VDP_WRITE_DATA_REG = ' ';
-		addr += 3;
 	}
 }
 
-static void spawn_enemy(void)
+static COLD void spawn_enemy(void)
 {
 	u16 r = random();
 	u8 row, type;
@@ -696,29 +1608,29 @@ static void spawn_enemy(void)
 		((type == SAUCER || type == PRIZE) && countdown != 0)
 	);
 
+	const struct speeds *sp = LEVEL_SPEEDS;
 	enemy[row].type = type;
 	if (type == ARROW) {
-		noise = noise_spawn;
-		enemy[row].v = 20;
+		noise_play(noise_spawn, 1);
+		enemy[row].dx = sp->arrow;
 	} else {
-		enemy[row].v = (r & 15)+5;
+		enemy[row].dx = sp->spawn[r & 15];
 	}
 	if (r & 0x1000) {
 		enemy[row].x = 0x0100;
 	} else {
 		enemy[row].x = 0xef00;
-		enemy[row].v = -enemy[row].v;
+		enemy[row].dx = -enemy[row].dx;
 	}
 	if (type == PRIZE || type == SAUCER) {
-		enemy[row].v = 0;
+		enemy[row].dx = 0;
 		countdown = 160;
 	}
-	if (level >= 6) {
-		enemy[row].v *= 2;
-	}
+	enemy[row].drawn = enemy[row].x >> 8;
+	event(EV_SPAWN, row, type);
 }
 
-static void respawn_enemies(void)
+static COLD void respawn_enemies(void)
 {
 	memset(enemy, 0, sizeof(enemy));
 	u16 n = level < 6 ? level + 2 : level - 2;
@@ -729,101 +1641,381 @@ static void respawn_enemies(void)
 }
 
 
-static void draw_field(void)
-{
-
-	vdp_memset(SCRTAB, ' ', 32*2);
-
-	for (u16 y = 2; y < 24; y++) {
-		switch (y) {
-		case 2: case 23:
-			vdp_memset(SCRTAB + y*32, '!', 32);
-			break;
-		case 5: case 8: case 11: case 14: case 17: case 20:
-			vdp_memset(SCRTAB + y*32, '!', 14);
-			vdp_memset(SCRTAB + y*32+14, ' ', 4);
-			vdp_memset(SCRTAB + y*32+18, '!', 14);
-			break;
-		default:
-			vdp_memset(SCRTAB + y*32, ' ', 32);
-			break;
-		}
-	}
-
-	// setup sprite list
+// initial sprite list, written in one burst by load_level()
+#define SPR_ROW(i, pat) (i) * 24 + 23, 128, (pat), 0
+static const u8 field_spr[] = {
 	// bullets for each row
-	for (u16 i = 0; i < 7; i++) {
-		u8 sp[] = {
-			i * 24 + 23, 128, 0, 0,
-			i * 24 + 23, 128, 4, 0};
-		vdp_write(SPRTAB + i*8, sp, sizeof(sp));
-	}
+#ifdef BAND_BULLETS
+	SPR_ROW(0, 0), SPR_ROW(1, 0), SPR_ROW(2, 0), SPR_ROW(3, 0),
+	SPR_ROW(4, 0), SPR_ROW(5, 0), SPR_ROW(6, 0),
+#else
+	SPR_ROW(0, 0), SPR_ROW(0, 4),
+	SPR_ROW(1, 0), SPR_ROW(1, 4),
+	SPR_ROW(2, 0), SPR_ROW(2, 4),
+	SPR_ROW(3, 0), SPR_ROW(3, 4),
+	SPR_ROW(4, 0), SPR_ROW(4, 4),
+	SPR_ROW(5, 0), SPR_ROW(5, 4),
+	SPR_ROW(6, 0), SPR_ROW(6, 4),
+#endif
 	// ship
-	{
-		u8 sp[] = {
-			24 + 23, 128, 0, 0};
-		vdp_write(SPRTAB + 14*4, sp, sizeof(sp));
-	}
+	SPR_ROW(1, 0),
 	// enemies for each row
-	for (u16 i = 0; i < 7; i++) {
-		u8 sp[] = {
-			i * 24 + 23, 128, 12, 0};
-		vdp_write(SPRTAB + (i+15)*4, sp, sizeof(sp));
-	}
+	SPR_ROW(0, 12),
+	SPR_ROW(1, 12),
+	SPR_ROW(2, 12),
+	SPR_ROW(3, 12),
+	SPR_ROW(4, 12),
+	SPR_ROW(5, 12),
+	SPR_ROW(6, 12),
+	0xd0, // sprite list terminator
+};
 
-	vdp_memset(SPRTAB + 22*4, 0xd0, 1); // sprite list terminator
-	ecount = level * 26 + 47;
+static COLD OVERLAY(level) void draw_field(void)
+{
+	// playfield layout comes from field.txt, packed by the Makefile
+	vdp_unrle(SCR(SCRTAB), field_rle);
 }
 
-static void load_level(void)
+// everything for the start of a level that isn't on screen
+static COLD OVERLAY(level) void level_reset(void)
 {
-	draw_field();
+	ecount = level * 26 + 47;
 	memset(bullet, 0, sizeof(bullet));
-	draw_score();
-	sound = (u16*)0;
-	noise = (u8*)0;
 	respawn_enemies();
-	draw_ships();
 	ship.dir = 0;
 	ship.x = 120;
 	ship.y = 3;
 }
 
+// the screen at the start of a level, for both_pages()
+static COLD OVERLAY(level) void draw_level(void)
+{
+	draw_field();
+	vdp_write(SPR(SPRTAB), field_spr, sizeof(field_spr));
+	draw_score();
+	draw_ships();
+}
+
+static COLD OVERLAY(level) void load_level(void)
+{
+	level_reset();
+	both_pages(draw_level);
+	sound_stop();
+	logic_steps_reset();
+}
+
+static u16 transition; // frames left of the rainbow between levels
 
+// Tasks are stackless resumable functions for things that take many
+// frames, like the ship blowing up, so the game goes on meanwhile.  main()
+// calls the running task once every logic step until it returns 0.
+// TASK_YIELD() returns and the next call resumes right after it, so
+// anything that has to last across a yield must be static.
+#define TASK_BEGIN(line) switch (line) { case 0:
+#define TASK_YIELD(line) do { (line) = __LINE__; return 1; case __LINE__:; } while (0)
+#define TASK_END(line) } (line) = 0; return 0
 
-static void draw_shifted(u16 addr, u8 old_x, u8 x, u8 bg)
+static u8 (*task)(void); // running task or 0
+
+#ifdef FRAME_METER
+// Debug build for timing on real consoles (turmoil_meter.bin).  The top
+// right corner shows how long the game was busy in the last frame, one
+// wall char per 1/14 of a 60Hz frame, and how many frames have overrun
+// since power up.  Left of that is how many bytes of the stack reserve
+// (see linkfile) have been used, stack_paint() fills it at power up.
+static u16 meter_start, meter_overruns;
+
+#define STACK_PAINT 0xa5
+extern u8 __STACK_LIMIT[];
+
+static void stack_paint(void)
 {
-	if ((old_x ^ x) & 0xf8) {
-		// char position changed
-		// erase left or right chars
+	u8 here;
+	for (u8 *p = __STACK_LIMIT; p < &here - 16; p++)
+		*p = STACK_PAINT;
+}
 
-		if (old_x < x) {
-			// moving right
-			set_vdp_write_address(addr-1);
-			VDP_WRITE_DATA_REG = ' ';
-			set_vdp_write_address(addr+32-1);
-			VDP_WRITE_DATA_REG = ' ';
-		} else {
-			// moving left
-			set_vdp_write_address(addr+3);
-			VDP_WRITE_DATA_REG = ' ';
-			set_vdp_write_address(addr+32+3);
-			VDP_WRITE_DATA_REG = ' ';
+static void meter_number(u16 addr, u16 j, u16 digits)
+{
+	static const u16 places[] = {10000,1000,100,10,1};
+	set_scr_address(addr, digits);
+	for (u16 i = 5 - digits; i < 5; i++) {
+		u8 digit = '0';
+		while (j >= places[i]) {
+			j -= places[i];
+			digit++;
 		}
+		VDP_WRITE_DATA_REG = digit;
+	}
+}
+
+static void frame_meter(u16 now, u8 late)
+{
+	u16 n = ((meter_start - now) & 0x3fff) / (TIMER_STEP / 14);
+
+	meter_start = timer_read();
+	if (late)
+		meter_overruns++;
+	if (transition)
+		return;
+
+	set_scr_address(SCRTAB + 32 + 18, 14);
+	for (u16 i = 0; i < 14; i++)
+		VDP_WRITE_DATA_REG = i < n ? '!' : ' ';
+
+	meter_number(SCRTAB + 27, meter_overruns, 5);
+
+	u8 *p = __STACK_LIMIT;
+	while (*p == STACK_PAINT)
+		p++;
+	meter_number(SCRTAB + 24, 0x8400 - (u16)p, 2);
+}
+#endif
+
+// Show the rainbow between levels.  transition_step() animates it for 256
+// frames and sets up the next level behind it meanwhile.
+static COLD OVERLAY(level) void transition_start(void)
+{
+	vdp_memset(SPRTAB, 0xd0, 1); // sprite list terminator
+	page_reset(); // the first pair is shown when the rainbow ends
+	task = 0; // the new level is drawn from scratch anyway
+	sound_stop(); // tone 2 is played directly below
+	event(EV_LEVEL, 0, level);
+	vdp_memset(RBWTAB + 32*11 + 16, level+'0', 1);
+	vdp_reg(2, RBWTAB/0x400);
+
+	SND_REG = 0xd2;
+	SND_REG = 0xff;
+	transition = 256;
+}
+
+#define OFF1 88
+#define OFF2 0
+
+// One frame of the rainbow, plus one piece of the next level so no frame
+// writes much more to the VDP than a frame of play.  The rainbow itself
+// is 768 bytes a frame, the playfield another 768.
+static COLD OVERLAY(level) void transition_step(void)
+{
+	u16 i = 256 - transition;
+	const u8 *rainbow_ch = asset(ASSET_RAINBOW_CH);
+	const u8 *rainbow_co = asset(ASSET_RAINBOW_CO);
+	u8 off = 0;
+	u16 s = 0x400 - ((i & 0xf0)*3 + (i & 0xf)*16);
+	SND_REG = 0xc0 | (s & 0xf);
+	SND_REG = s >> 4;
+	for (u16 j = 0; j < 0x1800; j += 0x800) {
+		vdp_write8(PATTAB+j + 'A'*8, rainbow_ch+((OFF2-i+off) & 0xff), 8);
+		vdp_write8(CLRTAB+j + 'A'*8, rainbow_co+((OFF2-i+off) & 0xff), 8);
+		vdp_write8(PATTAB+j + 'a'*8, rainbow_ch+((OFF1+i+off) & 0xff), 8);
+		vdp_write8(CLRTAB+j + 'a'*8, rainbow_co+((OFF1+i+off) & 0xff), 8);
+		off += 64;
+	}
+
+	switch (i) {
+	case 0:
+		level_reset(); // no VDP writes
+		break;
+	case 1:
+		draw_field();
+		break;
+#ifdef PAGE_FLIP
+	case 2:
+		// that was the hidden page, now the one shown after the rainbow
+		page_swap();
+		draw_field();
+		page_swap();
+		break;
+#endif
+	case 3:
+		both_pages(draw_score);
+		both_pages(draw_ships);
+		break;
+	case 4:
+		// sprites behind the terminator
+		vdp_write(SPRTAB+1, field_spr+1, sizeof(field_spr)-1);
+#ifdef PAGE_FLIP
+		vdp_write(SPR(SPRTAB), field_spr, sizeof(field_spr));
+#endif
+		break;
+	}
+
+	if (--transition == 0) {
+		vdp_memset(SPRTAB, field_spr[0], 1);
+		vdp_reg(2, SCRTAB/0x400);
+		sound_stop();
+		logic_steps_reset();
 	}
+}
+
+// The attract mode replays a joystick recording made by record.c (see
+// "make attract.h") from a fixed start, so it shows real play.  When the
+// recording runs out the game must be on the score and random() seed it
+// was recorded with, otherwise it is stale and the attract mode falls
+// back to wandering.  Being the same every time, it also serves as a
+// timing benchmark.
+#define ATTRACT_SEED 0x5a5a
+
+static COLD OVERLAY(level) void attract_start(void)
+{
+	seed = ATTRACT_SEED;
+	demo = 0;
+	ships = 2;
+	score = 0; // for the end check, draw_score() shows hiscore
+	level = 1;
+	ship.move = 0;
+	js = 0xff00;
+	replay = attract_rle;
+	replay_count = 0;
+	task = 0;
+	load_level();
+}
 
+static u16 attract_input(void)
+{
+#ifdef RECORD
+	return host_attract();
+#else
+	if (!replay_count) {
+		replay_count = replay[0];
+		replay += 2;
+	}
+	replay_count--;
+	return replay[-1] << 8;
+#endif
+}
+
+#if defined(HOST) && !defined(RECORD)
+static void show_bullet(u16 i);
+
+// A game in progress, saved and loaded by the runners so they can start
+// on a late level without playing up to it.  The screen isn't kept,
+// snapshot_load() redraws it the way load_level() does and the enemies
+// and ship are drawn by the next frame.
+struct snapshot {
+	u16 size; // sizeof(struct snapshot), checked when loading
+	u8 enemy[sizeof(enemy)];
+	u16 bullet[7];
+	u8 ship[sizeof(ship)];
+	u16 score, level, ecount, countdown, ships, seed, count10, wpat;
+	u8 wcount;
+};
+
+static void snapshot_save(struct snapshot *s)
+{
+	memset(s, 0, sizeof(*s));
+	s->size = sizeof(*s);
+	memcpy(s->enemy, enemy, sizeof(enemy));
+	memcpy(s->bullet, bullet, sizeof(bullet));
+	memcpy(s->ship, &ship, sizeof(ship));
+	s->score = score;
+	s->level = level;
+	s->ecount = ecount;
+	s->countdown = countdown;
+	s->ships = ships;
+	s->seed = seed;
+	s->count10 = count10;
+	s->wpat = wpat;
+	s->wcount = wcount;
+}
+
+static void snapshot_bullets(void)
+{
+	for (u16 i = 0; i < 7; i++) {
+		if (bullet[i])
+			show_bullet(i);
+	}
+}
+
+static void snapshot_load(const struct snapshot *s)
+{
+	memcpy(enemy, s->enemy, sizeof(enemy));
+	memcpy(bullet, s->bullet, sizeof(bullet));
+	memcpy(&ship, s->ship, sizeof(ship));
+	score = s->score;
+	level = s->level;
+	ecount = s->ecount;
+	countdown = s->countdown;
+	ships = s->ships;
+	seed = s->seed;
+	count10 = s->count10;
+	wpat = s->wpat;
+	wcount = s->wcount;
+	demo = 0;
+	replay = 0;
+	transition = 0;
+	task = 0;
+
+	for (u16 i = 0; i < 7; i++)
+		enemy[i].drawn = enemy[i].x >> 8;
+
+	page_reset();
+	vdp_reg(2, SCRTAB/0x400);
+	both_pages(draw_level);
+	both_pages(snapshot_bullets);
+	sound_stop();
+}
+#endif
+
+
+
+// The char position changed by d, erase the chars left behind on the left
+// or right of the 3 at addr, more than one after several logic steps.
+static inline void erase_trail(u16 addr, s16 d)
+{
+	u16 n;
+
+	if (d > 0) {
+		// moving right
+		addr -= d;
+		n = d < 3 ? d : 3;
+	} else {
+		// moving left
+		d = -d;
+		addr += d < 3 ? 3 : d;
+		n = d < 3 ? d : 3;
+	}
+	set_scr_address(addr, n);
+	do VDP_WRITE_DATA_REG = ' '; while (--n);
+}
+
+// One char row of a moving object, 3 chars at addr.  A trail on the left
+// ends where the chars start and one on the right starts where they end,
+// so vdp_seek() sets the VDP address once per row when d is 1 or 2.
+static inline void draw_row(u16 addr, s16 d, u8 a, u8 b, u8 c)
+{
+	if (d > 0)
+		erase_trail(addr, d);
+	set_scr_address(addr, 3);
+	VDP_WRITE_DATA_REG = a;
+	VDP_WRITE_DATA_REG = b;
+	VDP_WRITE_DATA_REG = c;
+	if (d < 0)
+		erase_trail(addr, d);
+}
+
+static HOT void draw_shifted(u16 addr, u8 old_x, u8 x, u8 bg)
+{
+	s16 d = (x >> 3) - (old_x >> 3);
 	u8 shift = x & 7;
-	set_vdp_write_address(addr);
-	VDP_WRITE_DATA_REG = bg+shift;
-	VDP_WRITE_DATA_REG = bg;
-	VDP_WRITE_DATA_REG = bg+shift+8;
-	set_vdp_write_address(addr+32);
+
+	draw_row(addr, d, bg+shift, bg, bg+shift+8);
 	bg += 16;
-	VDP_WRITE_DATA_REG = bg+shift;
-	VDP_WRITE_DATA_REG = bg;
-	VDP_WRITE_DATA_REG = bg+shift+8;
+	draw_row(addr+32, d, bg+shift, bg, bg+shift+8);
 }
 
+#ifdef SOFT_ENEMIES
+// like draw_shifted() but with the pre-shifted chars from soft_tiles()
+static HOT void draw_soft(u16 addr, u8 old_x, u8 x, const u8 *ch)
+{
+	s16 d = (x >> 3) - (old_x >> 3);
+	u8 c = ch[(x & 7) >> 1];
+
+	draw_row(addr, d, c, c+1, c+2);
+	draw_row(addr+32, d, c+3, c+4, c+5);
+}
+#endif
+
 static const u16 row_offset[7] = {
 	SCRTAB + 32 * 3,
 	SCRTAB + 32 * 6,
@@ -834,21 +2026,133 @@ static const u16 row_offset[7] = {
 	SCRTAB + 32 * 21,
 };
 
-static void erase_ship(u8 row, u8 x)
+#ifdef PAGE_FLIP
+// VRAM to VRAM through a small buffer on the stack
+static void vdp_copy(u16 dst, u16 src, u16 count)
+{
+	u8 buf[8];
+
+	while (count) {
+		u16 n = count < 8 ? count : 8;
+		vdp_read(src, buf, n);
+		vdp_write(dst, buf, n);
+		src += n;
+		dst += n;
+		count -= n;
+	}
+}
+
+// Called by vsync(): show the pages drawn during the frame and bring the
+// other pair up to date, it takes the next frame.
+static void page_flip(void)
+{
+	u16 i;
+
+	if (transition)
+		return; // the rainbow is shown, see transition_step()
+	for (i = 0; (dirty[i] >> 4) > (dirty[i] & 0x0f); )
+		if (++i == 9)
+			return; // nothing was drawn
+
+	vdp_reg(2, SCR(SCRTAB)/0x400);
+	vdp_reg(5, SPR(SPRTAB)/0x80);
+	page_swap();
+
+	u16 shown = scr_off ^ (SCRTAB2 - SCRTAB);
+	for (i = 0; i < 9; i++) {
+		u8 lo = dirty[i] >> 4, hi = dirty[i] & 0x0f;
+		if (lo > hi)
+			continue;
+		if (i == PAGE_SPR) {
+			u16 addr = SPRTAB + lo * 8;
+			vdp_copy(SPR(addr), addr + (u16)-(shown >> 3), (hi - lo + 1) * 8);
+		} else {
+			u16 addr = (i == 7 ? SCRTAB : row_offset[i]) + lo * 2;
+			u16 n = (hi - lo + 1) * 2;
+			vdp_copy(SCR(addr), addr + shown, n);
+			vdp_copy(SCR(addr+32), addr+32 + shown, n);
+		}
+	}
+	page_clean();
+}
+#endif
+
+static HOT void erase_ship(u8 row, u8 x)
 {
 	u16 addr = row_offset[row] + (x >> 3);
+	u8 n = x&7 ? 3 : 2;
 
-	set_vdp_write_address(addr);
+	set_scr_address(addr, n);
 	VDP_WRITE_DATA_REG = ' ';
 	VDP_WRITE_DATA_REG = ' ';
 	if (x&7) VDP_WRITE_DATA_REG = ' ';
-	set_vdp_write_address(addr+32);
+	set_scr_address(addr+32, n);
 	VDP_WRITE_DATA_REG = ' ';
 	VDP_WRITE_DATA_REG = ' ';
 	if (x&7) VDP_WRITE_DATA_REG = ' ';
 }
 
-static void do_player_ship(void)
+#ifdef BAND_BULLETS
+// 1 if the red line of the bullet in row i at x would cover the ship,
+// which is chars too.  The line waits until it is past them.
+static inline u16 bullet_on_ship(u16 i, u8 x)
+{
+	return i == ship.y && abs16((x >> 3) - (ship.x >> 3)) < 3;
+}
+
+// The red line of the bullet in row i at x, drawn at old_x before, on the
+// upper char row of its lane.
+static HOT void draw_bullet(u16 i, u8 old_x, u8 x)
+{
+	u16 addr = row_offset[i] + (x >> 3);
+	s16 d = (x >> 3) - (old_x >> 3);
+	u8 shift = x & 7;
+
+	if (bullet_on_ship(i, x))
+		return;
+	if (bullet_on_ship(i, old_x))
+		d = 0; // nothing was drawn there
+	draw_row(addr, d, BULLET_CH+shift, BULLET_CH, BULLET_CH+shift+8);
+}
+#endif
+
+// a bullet just fired in row i, or put back by snapshot_load()
+static void show_bullet(u16 i)
+{
+	u8 x = bullet[i] >> 8;
+
+	set_spr_address(SPRTAB_BULLET(i) + 1);
+	VDP_WRITE_DATA_REG = x;
+	set_spr_address(SPRTAB_BULLET(i) + 3);
+	VDP_WRITE_DATA_REG = 15;
+#ifdef BAND_BULLETS
+	draw_bullet(i, x, x);
+#else
+	set_spr_address(SPRTAB_BULLET(i) + 5);
+	VDP_WRITE_DATA_REG = x;
+	set_spr_address(SPRTAB_BULLET(i) + 7);
+	VDP_WRITE_DATA_REG = 6;
+#endif
+}
+
+static void hide_bullet(u16 i)
+{
+	set_spr_address(SPRTAB_BULLET(i) + 3);
+	VDP_WRITE_DATA_REG = 0; // sprite color transparent
+#ifdef BAND_BULLETS
+	u8 x = bullet[i] >> 8;
+	if (bullet[i] && !bullet_on_ship(i, x)) {
+		u16 n = x & 7 ? 3 : 2;
+		set_scr_address(row_offset[i] + (x >> 3), n);
+		do VDP_WRITE_DATA_REG = ' '; while (--n);
+	}
+#else
+	set_spr_address(SPRTAB_BULLET(i) + 7);
+	VDP_WRITE_DATA_REG = 0; // sprite color transparent
+#endif
+}
+
+static HOT void do_player_ship(void)
 {
 	u8 old_x = ship.x;
 
@@ -861,7 +2165,7 @@ static void do_player_ship(void)
 		js &= ~JOYSTICK_FIRE;
 
 	} else {
-		js = read_joystick();
+		js = replay ? attract_input() : read_joystick();
 
 		if (!(js & JOYSTICK_RIGHT)) {
 			ship.dir = 0;
@@ -876,7 +2180,6 @@ static void do_player_ship(void)
 					ship.x -= 4;
 			}
 		}
-		play_sounds();
 	}
 
 	if (!demo && ship.move) {
@@ -890,7 +2193,7 @@ static void do_player_ship(void)
 			ship.x = 0x78;
 		}
 		ship.move = 3;
-		sound = sound_move;
+		sound_play(sound_move, PRIO_MOVE, 1);
 	} else if (!(js & JOYSTICK_UP)) {
 		if (ship.y > 0) {
 			erase_ship(ship.y, old_x);
@@ -898,90 +2201,96 @@ static void do_player_ship(void)
 			ship.x = 0x78;
 		}
 		ship.move = 3;
-		sound = sound_move;
+		sound_play(sound_move, PRIO_MOVE, 1);
 	}
 
 	u16 addr = row_offset[ship.y] + (ship.x >> 3);
 	draw_shifted(addr, old_x, ship.x, 0x80);
 
-	set_vdp_write_address(SPRTAB_SHIP);
+	set_spr_address(SPRTAB_SHIP);
 	VDP_WRITE_DATA_REG = ship.y*24+23;
 	VDP_WRITE_DATA_REG = ship.x;
 	VDP_WRITE_DATA_REG = ship.dir*4+8;
 	VDP_WRITE_DATA_REG = 1; // black
 
 	if (!(js & JOYSTICK_FIRE) && bullet[ship.y] == 0 && enemy[ship.y].type != PRIZE && ship.x == 0x78) {
-		u16 i = ship.y;
-		bullet[i] = 0x7800;
-		u8 sp_c[] = {15, 6};
-		vdp_write(SPRTAB_BULLETS + i*8 + 3, sp_c, 1);
-		vdp_write(SPRTAB_BULLETS + i*8 + 7, sp_c+1, 1);
-		u8 sp_x[] = {bullet[i] >> 8};
-		vdp_write(SPRTAB_BULLETS + i*8 + 1, sp_x, 1);
-		vdp_write(SPRTAB_BULLETS + i*8 + 5, sp_x, 1);
-		sound = sound_shoot;
+		bullet[ship.y] = 0x7800;
+		show_bullet(ship.y);
+		sound_play(sound_shoot, PRIO_SHOOT, 1);
 	}
 }
 
-static void lose_ship(void)
-{
-	set_vdp_write_address(SPRTAB_BULLETS+ship.y*8+3);
-	VDP_WRITE_DATA_REG = 0; // sprite color transparent
-	set_vdp_write_address(SPRTAB_BULLETS+ship.y*8+7);
-	VDP_WRITE_DATA_REG = 0; // sprite color transparent
-
+static u16 death_line;
+static u8 death_i, death_wait;
 
-	u16 addr = row_offset[ship.y] + (ship.x >> 3);
-	draw_shifted(addr, ship.x, ship.x, 0x80);
-	u8 spr_base = ship.dir ? 28 : 33;
+// Explosion and respawn of the ship, or game over when it was the last
+// one, as a task.  The ship takes no input and can't be hit meanwhile.
+static COLD OVERLAY(level) u8 death_task(void)
+{
 	static const u8 anim[] = {0,1,2,3,4,4,4,4,3,2,1,0};
-	sound = sound_shoot;
-	noise = (u8*)0;
-	for (u16 i = 0; i < sizeof(anim); i++) {
-		set_vdp_write_address(SPRTAB_SHIP+1);
+
+	TASK_BEGIN(death_line);
+	for (death_i = 0; death_i < sizeof(anim); death_i++) {
+		u8 pat = (ship.dir ? 28 : 33) + anim[death_i];
+		set_spr_address(SPRTAB_SHIP+1);
 		VDP_WRITE_DATA_REG = ship.x;
-		VDP_WRITE_DATA_REG = (spr_base+anim[i])*4;
-		play_sounds();
-		for (u16 j = 0; j < 10; j++)
-			vsync();
-		play_sounds();
-		for (u16 j = 0; j < 10; j++)
-			vsync();
-		if (i == 6) {
+		VDP_WRITE_DATA_REG = (pat < 32 ? pat : pat - 32 + SPRPAT_HI)*4;
+		for (death_wait = 0; death_wait < 20; death_wait++) {
+			// enemies passing through leave holes in it
+			u16 addr = row_offset[ship.y] + (ship.x >> 3);
+			draw_shifted(addr, ship.x, ship.x, 0x80);
+			TASK_YIELD(death_line);
+		}
+		if (death_i == 6) {
 			erase_ship(ship.y, ship.x);
 			ship.x = 0x78;
 			if (ships == 0) {
 				// game over
 
-				sound = sound_move;
-				for (u16 i = 0; i < 255; i++) {
-					vdp_memset(CLRTAB+'0'*8, 0xe0+(i&16), 10*8);
-					if ((i & 0xf) == 0)
-						play_sounds();
-					vsync();
+				sound_play(sound_move, PRIO_DEATH, 16);
+				for (death_wait = 0; death_wait < 255; death_wait++) {
+					vdp_memset(CLRTAB+'0'*8, 0xe0+(death_wait&16), 10*8);
+					TASK_YIELD(death_line);
 				}
 				demo = 1;
-				if (score > hiscore)
+				if (!replay && score > hiscore)
 					hiscore = score;
 				score = hiscore;
 				draw_score();
-				return;
+				return 0;
 			}
 			ships--;
 			draw_ships();
-			addr = row_offset[ship.y] + (ship.x >> 3);
-			draw_shifted(addr, ship.x, ship.x, 0x80);
-			noise = noise_spawn;
+			noise_play(noise_spawn, 10);
 		}
 	}
+	if (level < 9 && ecount == 0) {
+		// the last enemy was shot while the ship was down
+		level++;
+		if (ships < 5) ships++;
+		transition_start();
+	}
+	TASK_END(death_line);
 }
 
-static void clear_enemy(u16 i)
+static COLD OVERLAY(level) void lose_ship(void)
 {
-	erase_ship(i, enemy[i].x >> 8);
+	// the bullet flies on unseen
+	hide_bullet(ship.y);
+	event(EV_SHIP, ship.y, ships);
+
+	sound_play(sound_shoot, PRIO_DEATH, 10);
+	noise_play(0, 0);
+	death_line = 0;
+	task = death_task;
+}
+
+static HOT void clear_enemy(u16 i)
+{
+	erase_ship(i, enemy[i].drawn);
 	enemy[i].type = IDLE;
 	enemy[i].x = 0;
-	set_vdp_write_address(SPRTAB_ENEMIES+(i*4)+3);
+	set_spr_address(SPRTAB_ENEMIES+(i*4)+3);
 	VDP_WRITE_DATA_REG = 0; // sprite color transparent
 
 }
@@ -996,222 +2305,318 @@ static void clear_enemy(u16 i)
  *
  * Returns    : Nothing
  */
-void main()
+HOT void main()
 {
 	init_vdp();
+	sound_stop();
+#ifdef FRAME_METER
+	stack_paint();
+#endif
+#ifdef EVENT_LOG
+	memset(&events, 0, sizeof(events)); // expansion RAM isn't cleared by crt0.c
+#endif
 	
+	ovl_load(OVL_INIT);
 	setup();
+#ifdef SOFT_ENEMIES
+	soft_tiles();
+#endif
 
-
-	draw_field();
-	draw_score();
-	respawn_enemies();
+	ovl_load(OVL_LEVEL);
+	attract_start();
+	timer_start();
 
 	for(;;) {
+		if (transition) {
+			ovl_load(OVL_LEVEL);
+			transition_step();
+			vsync();
+			continue;
+		}
 
+		// Logic runs in fixed steps, see logic_steps().  Only the last
+		// step of a frame draws the enemies, enemy[].drawn keeps where their
+		// chars are so erase_trail() can clean up after several steps.
+		u16 steps = logic_steps();
+		while (steps) {
+			steps--;
 
-		//VDP_ADDRESS_REG = 0xf7;
-		//VDP_ADDRESS_REG = 0x87;
+			//VDP_ADDRESS_REG = 0xf7;
+			//VDP_ADDRESS_REG = 0x87;
 
 
-		// cycle wall color every N frames
-		if (wcount++ == 0) {
-			u8 c;
-			if (++wpat >= sizeof(wall_pal)) 
-				wpat = 0;
-			c = wall_pal[wpat];
-			vdp_memset(CLRTAB + '!'*8+1, c, 5);
-			vdp_memset(CLRTAB2 + '!'*8+1, c, 5);
-			vdp_memset(CLRTAB3 + '!'*8+1, c, 5);
-		}
-		//VDP_ADDRESS_REG = 0xf4;
-		//VDP_ADDRESS_REG = 0x87;
-
-		u8 ship_y = ship.y;
-		for (u16 i = 0; i < 7; i++) {
-			static u16 old_x, t, bx;
-			old_x = enemy[i].x;
-			t = enemy[i].type;
-
-			// handle bullet
-			bx = bullet[i];
-			if (bx) {
-				if (bx && bx != 0x7800 && bx + 0x0f00 >= old_x && bx <= old_x + 0x0f00 && 
-					t != IDLE && t != SAUCER && t != PRIZE) {
-					// bullet hitting enemy
-					if (t == TANK && (bx < 0x7800) == (enemy[i].v > 0)) {
-						if (old_x > 0x1000 && old_x < 0xE000) {
-							erase_ship(i, old_x >> 8);
-							enemy[i].x -= enemy[i].v << 7;
-						}
-					} else if (t != EXPLODE) {
-						if (!demo) {
-							score += spridx[t].score;
-							draw_score();
-							if (level < 9 && --ecount == 0) {
-								level++;
-								if (ships < 5) ships++;
-								rainbow();
-								load_level();
-								break;
+			if (task) {
+				ovl_load(OVL_LEVEL);
+				if (!task())
+					task = 0;
+				if (transition)
+					break;
+			}
+
+			// cycle wall color every N frames
+			if (wcount++ == 0) {
+				u8 c;
+				if (++wpat >= sizeof(wall_pal)) 
+					wpat = 0;
+				c = wall_pal[wpat];
+				vdp_memset(CLRTAB + '!'*8+1, c, 5);
+				vdp_memset(CLRTAB2 + '!'*8+1, c, 5);
+				vdp_memset(CLRTAB3 + '!'*8+1, c, 5);
+			}
+			//VDP_ADDRESS_REG = 0xf4;
+			//VDP_ADDRESS_REG = 0x87;
+
+			u8 ship_y = ship.y;
+			for (u16 i = 0; i < 7; i++) {
+				static u16 old_x, t, bx;
+				old_x = enemy[i].x;
+				t = enemy[i].type;
+
+				// handle bullet
+				bx = bullet[i];
+				if (bx) {
+					if (bx && bx != 0x7800 && bx + 0x0f00 >= old_x && bx <= old_x + 0x0f00 && 
+						t != IDLE && t != SAUCER && t != PRIZE) {
+						// bullet hitting enemy
+						if (t == TANK && (bx < 0x7800) == (enemy[i].dx > 0)) {
+							// pushed back 8 steps, unless that leaves the
+							// row: from level 8 it is more than 0x1000
+							u16 x = old_x - enemy[i].dx * 8;
+							if (old_x > 0x1000 && old_x < 0xE000 && x < 0xF000) {
+								erase_ship(i, enemy[i].drawn);
+								enemy[i].x = x;
+								enemy[i].drawn = x >> 8;
+								event(EV_PUSH, i, enemy[i].drawn);
+							}
+						} else if (t != EXPLODE) {
+							event(EV_KILL, i, t);
+							if (!demo) {
+								score += spridx[t].score;
+								draw_score();
+								// not while the ship is down, death_task()
+								// starts the next level after it
+								if (level < 9 && ecount && --ecount == 0 && !task) {
+									level++;
+									if (ships < 5) ships++;
+									ovl_load(OVL_LEVEL);
+									transition_start();
+									break;
+								}
 							}
+							t = EXPLODE;
+							enemy[i].type = t;
+							enemy[i].dx = old_x < 0x7800 ? -LEVEL_SPEEDS->explode : LEVEL_SPEEDS->explode;
 						}
-						t = EXPLODE;
-						enemy[i].type = t;
-						enemy[i].v = old_x < 0x7800 ? -32 : 32;
+						bx = 0;
 					}
-					bx = 0;
-				}
-				if (bx < 0x666 || bx >= 0xf000) {
-					// sprite off
-					bx = 0;
-					//u8 sp_c[] = {0}; // set sprite color to 0 (invisible)
-					//vdp_write(SPRTAB + i*8 + 3, sp_c, 1);
-					//vdp_write(SPRTAB + i*8 + 7, sp_c, 1);
-					set_vdp_write_address(SPRTAB + i*8 + 3);
-					VDP_WRITE_DATA_REG = 0;
-					set_vdp_write_address(SPRTAB + i*8 + 7);
-					VDP_WRITE_DATA_REG = 0;
-				} else {
-					if (bx < 0x7800 || (bx == 0x7800 && ship.dir == 1)) {
-						bx -= 0x666;
+					if (bx < 0x666 || bx >= 0xf000) {
+						// sprite off
+						bx = 0;
+						//u8 sp_c[] = {0}; // set sprite color to 0 (invisible)
+						//vdp_write(SPRTAB + i*8 + 3, sp_c, 1);
+						//vdp_write(SPRTAB + i*8 + 7, sp_c, 1);
+#ifdef BAND_BULLETS
+						if (!(task && i == ship.y))
+							hide_bullet(i);
+#else
+						hide_bullet(i);
+#endif
 					} else {
-						bx += 0x666;
+						if (bx < 0x7800 || (bx == 0x7800 && ship.dir == 1)) {
+							bx -= 0x666;
+						} else {
+							bx += 0x666;
+						}
+#ifdef BAND_BULLETS
+						// the line every step, it has no drawn position of its own
+						if (!(task && i == ship.y))
+							draw_bullet(i, bullet[i] >> 8, bx >> 8);
+#endif
+						if (!steps) {
+							// set sprite x
+							set_spr_address(SPRTAB_BULLET(i) + 1);
+							VDP_WRITE_DATA_REG = bx >> 8;
+#ifndef BAND_BULLETS
+							set_spr_address(SPRTAB_BULLET(i) + 5);
+							VDP_WRITE_DATA_REG = bx >> 8;
+#endif
+						}
 					}
-					u8 sp_x[] = {bx >> 8}; // set sprite x
-					vdp_write(SPRTAB + i*8 + 1, sp_x, 1);
-					vdp_write(SPRTAB + i*8 + 5, sp_x, 1);
+					bullet[i] = bx;
 				}
-				bullet[i] = bx;
-			}
-
-			// handle player
-			if (ship_y == i) {
-				do_player_ship();
 
-				if (demo && !(read_joystick() & JOYSTICK_FIRE)) {
-					demo = 0;
-					ships = 4;
-					score = 0;
-					level = 1;
-
-					rainbow();
-					load_level();
-
-					break;
-				} 
-
-				if (abs((s16)(ship.x - (old_x >> 8))) < 14) {
-					erase_ship(i, old_x >> 8);
-					if (t == PRIZE) {
-						countdown = 0;
-						score += 80; // shows 800
+				// handle player
+				if (ship_y == i) {
+#ifndef RECORD
+					if (replay && !task && !replay_count && !*replay) {
+						// end of the recording, at the step its next input
+						// would have been read, as record.c stops there
+						if (score != ATTRACT_SCORE || seed != ATTRACT_END_SEED)
+							replay_bad = 1;
+						replay = 0;
+						demo = 1;
+						score = hiscore;
 						draw_score();
-						t = SAUCER;
-						old_x = 0xf000 - old_x;
-						enemy[i].type = t;
-						enemy[i].x = old_x;
-						goto spawn_saucer;
-					} else {
-						clear_enemy(i);
-						spawn_enemy();
+					}
+#endif
+					if (demo && !replay_bad) {
+						ovl_load(OVL_LEVEL);
+						attract_start();
+						break;
+					}
+					if (!task)
+						do_player_ship();
 
-						set_vdp_write_address(SPRTAB_ENEMIES+(i*4)+2);
-						VDP_WRITE_DATA_REG = 0; // sprite transparent
+					if ((demo || replay) && !(read_joystick() & JOYSTICK_FIRE)) {
+						replay = 0;
+						demo = 0;
+						ships = 4;
+						score = 0;
+						level = START_LEVEL;
+
+						ovl_load(OVL_LEVEL);
+						transition_start();
 
-						if (!demo) lose_ship();
 						break;
-					}
+					} 
+
+					if (!task && abs16(ship.x - (old_x >> 8)) < 14) {
+						erase_ship(i, enemy[i].drawn);
+						if (t == PRIZE) {
+							countdown = 0;
+							score += 80; // shows 800
+							event(EV_PRIZE, i, 0);
+							draw_score();
+							t = SAUCER;
+							old_x = 0xf000 - old_x;
+							enemy[i].type = t;
+							enemy[i].x = old_x;
+							enemy[i].drawn = old_x >> 8;
+							goto spawn_saucer;
+						} else {
+							clear_enemy(i);
+							spawn_enemy();
+
+							set_spr_address(SPRTAB_ENEMIES+(i*4)+2);
+							VDP_WRITE_DATA_REG = 0; // sprite transparent
+
+							if (!demo) {
+								ovl_load(OVL_LEVEL);
+								lose_ship();
+							}
+							break;
+						}
 
+					}
 				}
-			}
 
-			// handle enemy
-			if (t == IDLE)
-				continue;
-			if (enemy[i].v == 0) {
-				// SAUCER or PRIZE
-				if (t == SAUCER) {
-					if (--countdown != 0)
-						continue;
-					if (ship.y == i) {
-						spawn_saucer:
-						enemy[i].v = old_x < 0x8000 ? 15 : -15;
-						if (level >= 6) enemy[i].v *= 2;
-						sound = sound_saucer;
-					} else {
-						enemy[i].type = IDLE;
-						spawn_enemy();
-						continue;
-					}
-				} else if (t == PRIZE) {
-					if (--countdown == 0) {
-						t = BALL;
-						enemy[i].type = t;
-						enemy[i].v = old_x < 0x8000 ? 102 : -102;
+				// handle enemy
+				if (t == IDLE)
+					continue;
+				if (enemy[i].dx == 0) {
+					// SAUCER or PRIZE
+					if (t == SAUCER) {
+						if (--countdown != 0)
+							continue;
+						if (ship.y == i) {
+							spawn_saucer:
+							s16 dx = LEVEL_SPEEDS->saucer;
+							enemy[i].dx = old_x < 0x8000 ? dx : -dx;
+							sound_play(sound_saucer, PRIO_SAUCER, 1);
+							event(EV_SAUCER, i, old_x >> 8);
+						} else {
+							enemy[i].type = IDLE;
+							spawn_enemy();
+							continue;
+						}
+					} else if (t == PRIZE) {
+						if (--countdown == 0) {
+							t = BALL;
+							enemy[i].type = t;
+							enemy[i].dx = old_x < 0x8000 ? level_ball[level] : -level_ball[level];
+						}
 					}
 				}
-			}
 
-			enemy[i].x += enemy[i].v << 4; // sign-extend and shift
+				enemy[i].x += enemy[i].dx;
 			
-		//VDP_ADDRESS_REG = 0xf6;
-		//VDP_ADDRESS_REG = 0x87;
-
-			if (enemy[i].x >= 0xf000) {
-				// hit edge of screen
-				if (t == ARROW || t == TANK || t == BALL) {
-					enemy[i].v = -enemy[i].v;
-					enemy[i].x = old_x;
-					if (t == ARROW) {
-						enemy[i].type = TANK;
-						enemy[i].v = old_x < 0x7800 ? 25 : -25;
-					} else if (t == BALL) {
-						sound = sound_ball;
+			//VDP_ADDRESS_REG = 0xf6;
+			//VDP_ADDRESS_REG = 0x87;
+
+				if (enemy[i].x >= 0xf000) {
+					// hit edge of screen
+					if (t == ARROW || t == TANK || t == BALL) {
+						enemy[i].dx = -enemy[i].dx;
+						enemy[i].x = old_x;
+						if (t == ARROW) {
+							enemy[i].type = TANK;
+							enemy[i].dx = old_x < 0x7800 ? level_tank[level] : -level_tank[level];
+						} else if (t == BALL) {
+							sound_play(sound_ball, PRIO_BALL, 1);
+						}
+						continue;
 					}
+					// erase chars
+					erase_ship(i, enemy[i].drawn);
+					enemy[i].type = IDLE;
+					spawn_enemy();
 					continue;
 				}
-				// erase chars
-				erase_ship(i, old_x >> 8);
-				enemy[i].type = IDLE;
-				spawn_enemy();
-				continue;
-			}
 
-			u8 bg = 0xc0; // default enemy background
-			if (t == EXPLODE) {
-				bg = 0xa0; // explode
-			} else if (t == ARROW || t == SAUCER) {
-				bg = 0xe0; // arrow/saucer
+				if (steps)
+					continue; // drawn on the last step
+				if (level_lod[level] && ((i ^ lod_frame) & 1) && !bullet[i] &&
+					abs16(i - ship.y) > 1 && abs16(enemy[i].dx) < LOD_FAST)
+					continue; // slow and far from the ship, drawn next frame
+
+				u8 bg = 0xc0; // default enemy background
+				if (t == EXPLODE) {
+					bg = 0xa0; // explode
+				} else if (t == ARROW || t == SAUCER) {
+					bg = 0xe0; // arrow/saucer
+				}
+				u16 addr = row_offset[i] + (enemy[i].x >> 11);
+#ifdef SOFT_ENEMIES
+				if (soft_idx[t]) {
+					draw_soft(addr, enemy[i].drawn, enemy[i].x>>8, soft_enemy[soft_idx[t]-1].ch);
+					enemy[i].drawn = enemy[i].x >> 8;
+					set_spr_address(SPRTAB_ENEMIES+(i*4)+3);
+					VDP_WRITE_DATA_REG = 0; // sprite color transparent
+					continue;
+				}
+#endif
+				draw_shifted(addr, enemy[i].drawn, enemy[i].x>>8, bg);
+				enemy[i].drawn = enemy[i].x >> 8;
+
+				// update sprite
+				u8 sprite = 0;
+				set_spr_address(SPRTAB_ENEMIES+(i*4)+1);
+				VDP_WRITE_DATA_REG = enemy[i].x >> 8; // x pos
+				if (count10 <= 5)
+					sprite += 4;
+				if (enemy[i].dx < 0)
+					sprite += 8;
+				VDP_WRITE_DATA_REG = spridx[t].base + (spridx[t].mask & sprite); // sprite index
+				VDP_WRITE_DATA_REG = 1; // color (black)
+
+			//VDP_ADDRESS_REG = 0xf4;
+			//VDP_ADDRESS_REG = 0x87;
 			}
-			u16 addr = row_offset[i] + (enemy[i].x >> 11);
-			draw_shifted(addr, old_x>>8, enemy[i].x>>8, bg);
-
-			// update sprite
-			u8 sprite = 0;
-			set_vdp_write_address(SPRTAB_ENEMIES+(i*4)+1);
-			VDP_WRITE_DATA_REG = enemy[i].x >> 8; // x pos
-			if (count10 <= 5)
-				sprite += 4;
-			if (enemy[i].v < 0)
-				sprite += 8;
-			VDP_WRITE_DATA_REG = spridx[t].base + (spridx[t].mask & sprite); // sprite index
-			VDP_WRITE_DATA_REG = 1; // color (black)
-
-		//VDP_ADDRESS_REG = 0xf4;
-		//VDP_ADDRESS_REG = 0x87;
-		}
 
 
-		//VDP_ADDRESS_REG = 0xf1;
-		//VDP_ADDRESS_REG = 0x87;
+			//VDP_ADDRESS_REG = 0xf1;
+			//VDP_ADDRESS_REG = 0x87;
 
 
-		//VDP_ADDRESS_REG = 0xf1;
-		//VDP_ADDRESS_REG = 0x87;
+			//VDP_ADDRESS_REG = 0xf1;
+			//VDP_ADDRESS_REG = 0x87;
 
-		if (--count10 == 0) count10 = 10;
+			if (--count10 == 0) count10 = 10;
+			if (transition)
+				break;
+		}
 
+		lod_frame ^= 1;
 		vsync();
 
 	}
@@ -0,0 +1,136 @@
+/*
+ *  record.c - attract mode recorder for the Turmoil clone
+ *
+ * Builds the game from main.c for the host like soak.c does, starts the
+ * attract mode from its fixed seed and plays it with a random joystick.
+ * The joystick is written to stdout as attract.h, run-length encoded in
+ * (frames, joystick >> 8) pairs ending with a 0, together with the score
+ * and random() seed the run ends on.  The game checks those two when its
+ * replay of the recording runs out.
+ *
+ * Recording stops after the given number of frames, or when the last
+ * spare ship is gone so the replay never reaches game over.
+ *
+ * usage: turmoil-record [-f frames] [-s seed] > attract.h
+ */
+
+#define HOST
+#define RECORD
+#define main turmoil_main
+#include "main.c"
+#undef main
+
+#include <stdio.h>
+#include <unistd.h>
+
+#define MAX_PAIRS 256	// keep the recording small enough for the cartridge
+
+static unsigned frames = 1800, recorded, rng = 3;
+static u8 rle[MAX_PAIRS * 2];
+static unsigned len;
+
+static unsigned xorshift(void)
+{
+	rng ^= rng << 13;
+	rng ^= rng >> 17;
+	rng ^= rng << 5;
+	return rng;
+}
+
+// fire is never pressed outside the recording, that would start a game
+static u16 host_joystick(void)
+{
+	return 0xff00;
+}
+
+static void host_frame(void)
+{
+}
+
+static void finish(void)
+{
+	printf("// attract mode recording, made by turmoil-record\n");
+	printf("#define ATTRACT_SCORE %u\n", score);
+	printf("#define ATTRACT_END_SEED 0x%04x\n", seed);
+	printf("static const u8 attract_rle[] = {\n");
+	for (unsigned i = 0; i < len; i += 2)
+		printf("%u,0x%02x,%s", rle[i], rle[i+1], (i & 14) == 14 ? "\n" : " ");
+	printf("0 };\n");
+	fprintf(stderr, "turmoil-record: %u frames, %u bytes, level %u score %u\n",
+		recorded, len + 1, level, score);
+	exit(0);
+}
+
+// 1 if the enemy in row r is close and can't be shot in time
+static int danger(u16 r)
+{
+	u16 t = enemy[r].type;
+	u16 d = enemy[r].x > 0x7800 ? enemy[r].x - 0x7800 : 0x7800 - enemy[r].x;
+
+	if (t == IDLE || t == PRIZE || (t == SAUCER && enemy[r].dx == 0))
+		return 0;
+	return d < 0x3000 && (bullet[r] != 0 || t == TANK || t == SAUCER);
+}
+
+// Face and fire at whatever is in the ship's row, move away from enemies that
+// get too close, with some random moves mixed in so the recording shows
+// the whole playfield.
+static u16 host_attract(void)
+{
+	static u16 input = 0xff00, hold;
+
+	// Only called from do_player_ship(), which waits for a running task
+	// such as death_task(), and main() checks the end of the replay at
+	// that same step.
+	if (recorded == frames || ships == 0 || len == sizeof(rle))
+		finish();
+	recorded++;
+
+	if (hold) {
+		hold--;
+	} else {
+		unsigned r = xorshift();
+		input = 0xff00;
+		if (danger(ship.y) || (r & 15) == 0) {
+			if (ship.y == 6 || (ship.y > 0 && !danger(ship.y - 1) && (r & 0x10)))
+				input &= ~JOYSTICK_UP;
+			else
+				input &= ~JOYSTICK_DOWN;
+			hold = 4;
+		} else if (enemy[ship.y].type != IDLE && enemy[ship.y].type != PRIZE) {
+			// face it and shoot
+			input &= ~(enemy[ship.y].x < 0x7800 ? JOYSTICK_LEFT : JOYSTICK_RIGHT);
+			if (bullet[ship.y] == 0)
+				input &= ~JOYSTICK_FIRE;
+			hold = 2;
+		}
+	}
+
+	if (len && rle[len-1] == input >> 8 && rle[len-2] < 255) {
+		rle[len-2]++;
+	} else {
+		rle[len++] = 1;
+		rle[len++] = input >> 8;
+	}
+	return input;
+}
+
+int main(int argc, char *argv[])
+{
+	int c;
+
+	while ((c = getopt(argc, argv, "f:s:")) != -1) {
+		switch (c) {
+		case 'f': frames = strtoul(optarg, 0, 0); break;
+		case 's': rng = strtoul(optarg, 0, 0); break;
+		default:
+			fprintf(stderr, "usage: %s [-f frames] [-s seed] > attract.h\n", argv[0]);
+			return 2;
+		}
+	}
+	if (rng == 0)
+		rng = 1;
+
+	turmoil_main();
+	return 1;
+}
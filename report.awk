@@ -0,0 +1,289 @@
+# report.awk - per-function size and cycle report for turmoil
+#
+# usage: gawk -f report.awk [-v base=turmoil.rpt.base] turmoil.map turmoil.lst
+#
+# Reads the memory regions and output sections from the linker map, and
+# the disassembly from objdump -dS.  Prints one line per function with its
+# size in bytes and a static cycle count of its code: every instruction
+# counted once, so a loop counts a single trip and both sides of a branch
+# are added.  It is no worst case, only a figure that moves when the code
+# does.  Every operand in memory is assumed to be on the 8-bit bus, and 4
+# wait states are added for each access outside of scratchpad and console
+# ROM.  Then prints used and free bytes for each memory region.  The stack
+# region is the reserve the linker scripts keep below >8400, it counts as
+# used, so the scratchpad figure is what .data and .bss have left.
+#
+# If base names an earlier report, functions that got bigger or slower
+# and regions that lost headroom are flagged on stderr.  With -v side=1
+# the two reports are printed side by side instead.
+
+function hex(s,    n, i, c)
+{
+	s = tolower(s)
+	sub(/^0x/, "", s)
+	sub(/^>/, "", s)
+	n = 0
+	for (i = 1; i <= length(s); i++) {
+		c = index("0123456789abcdef", substr(s, i, 1))
+		if (c == 0)
+			break
+		n = n * 16 + c - 1
+	}
+	return n
+}
+
+# 1 if an access to addr goes through the 8-bit multiplexer
+function slow(addr)
+{
+	return !(addr < 0x2000 || (addr >= 0x8000 && addr < 0x8400))
+}
+
+# extra cycles for a general operand, sets mem to its memory accesses
+function operand(op, byte)
+{
+	mem = 0
+	if (op ~ /^\*r[0-9]+\+$/) {
+		mem = 1
+		return byte ? 6 : 8
+	}
+	if (op ~ /^\*r[0-9]+$/) {
+		mem = 1
+		return 4
+	}
+	if (op ~ /^@/) {
+		mem = 1
+		return 8
+	}
+	return 0
+}
+
+function shift_count(op)
+{
+	if (op ~ /^r?0$/)
+		return -1
+	return op ~ /^>/ ? hex(op) : op + 0
+}
+
+# worst-case cycles for one disassembled instruction at addr
+function cycles(addr, words, text,    m, ops, n, c, w, t, byte)
+{
+	n = split(text, ops, /[ \t]+/)
+	m = ops[1]
+	text = substr(text, length(m) + 1)
+	gsub(/[ \t]/, "", text)
+	n = split(text, ops, ",")
+
+	# instruction fetch, including immediates and symbolic addresses
+	w = slow(addr) ? 4 * words : 0
+
+	if (m in fmt1) {
+		byte = m ~ /b$/
+		c = fmt1[m] + operand(ops[1], byte)
+		w += 4 * mem
+		c += operand(ops[2], byte)
+		w += 4 * mem * (m ~ /^cb?$/ ? 1 : 2)
+		return c + w
+	}
+	if (m in fmt3) {
+		# source is a general operand, destination a register
+		c = fmt3[m] + operand(ops[1], 0)
+		return c + w + 4 * mem
+	}
+	if (m in fmt6) {
+		c = fmt6[m] + operand(ops[1], 0)
+		if (m !~ /^(b|bl|blwp|x)$/)
+			w += 4 * mem * 2
+		return c + w
+	}
+	if (m == "ldcr" || m == "stcr") {
+		c = operand(ops[1], 0)
+		w += 4 * mem
+		t = shift_count(ops[2])
+		if (t <= 0)
+			t = 16
+		if (m == "ldcr")
+			return c + w + 20 + 2 * t
+		return c + w + (t < 8 ? 42 : t == 8 ? 44 : t < 16 ? 58 : 60)
+	}
+	if (m ~ /^s(la|ra|rc|rl)$/) {
+		t = shift_count(ops[2])
+		if (t < 0)
+			return w + 52	# count in r0, assume 15
+		return w + 12 + 2 * t
+	}
+	if (m in fixed)
+		return w + fixed[m]
+	if (m ~ /^j/)
+		return w + 10
+	unknown[m]++
+	return w + 14
+}
+
+BEGIN {
+	split("a ab c cb s sb soc socb szc szcb mov movb", t, " ")
+	for (i in t) fmt1[t[i]] = 14
+	split("coc czc xor", t, " ")
+	for (i in t) fmt3[t[i]] = 14
+	fmt3["mpy"] = 52
+	fmt3["div"] = 124
+	fmt3["xop"] = 36
+	split("inv clr seto inc inct dec dect swpb", t, " ")
+	for (i in t) fmt6[t[i]] = 10
+	fmt6["neg"] = 12
+	fmt6["abs"] = 14
+	fmt6["b"] = 8
+	fmt6["bl"] = 12
+	fmt6["blwp"] = 26
+	fmt6["x"] = 8
+	split("sbo sbz tb", t, " ")
+	for (i in t) fixed[t[i]] = 12
+	split("ai andi ori ci", t, " ")
+	for (i in t) fixed[t[i]] = 14
+	fixed["li"] = 12
+	fixed["lwpi"] = 10
+	fixed["limi"] = 16
+	fixed["stst"] = 8
+	fixed["stwp"] = 8
+	fixed["rtwp"] = 14
+	split("idle rset ckon ckof lrex", t, " ")
+	for (i in t) fixed[t[i]] = 12
+	fixed["nop"] = 10
+}
+
+# linker map: memory regions
+FNR == 1 { file++ }
+file == 1 && /^Memory Configuration/ { inmem = 1; next }
+file == 1 && inmem && /^Linker script/ { inmem = 0 }
+file == 1 && inmem && $2 ~ /^0x/ && $1 != "*default*" {
+	regions[++nregions] = $1
+	origin[$1] = hex($2)
+	length_[$1] = hex($3)
+	if ($1 == "stack")
+		used[$1] = length_[$1] # no sections, all of it is kept
+	next
+}
+
+# linker map: output sections, possibly wrapped onto a second line
+file == 1 && /^\.[^ ]+$/ { pending = $1; next }
+file == 1 && (/^\.[^ ]+ +0x/ || (pending != "" && /^ +0x/)) {
+	if (pending != "") {
+		name = pending
+		$0 = name " " $0
+	}
+	pending = ""
+	name = $1
+	if (name ~ /^\.(debug|comment|stab)/)
+		next
+	size = hex($3)
+	if (size == 0)
+		next
+	vma = hex($2)
+	lma = $5 == "address" ? hex($6) : vma
+	for (r = 1; r <= nregions; r++) {
+		o = origin[regions[r]]
+		if (vma >= o && vma < o + length_[regions[r]])
+			used[regions[r]] += size
+		else if (lma != vma && lma >= o && lma < o + length_[regions[r]])
+			used[regions[r]] += size
+	}
+	next
+}
+file == 1 { pending = "" }
+
+# disassembly
+file == 2 && /^[0-9a-f]+ <[^>]+>:$/ {
+	func_ = $2
+	gsub(/[<>:]/, "", func_)
+	if (!(func_ in fsize))
+		order[++nfuncs] = func_
+	fsize[func_] += 0
+	next
+}
+file == 2 && func_ != "" && /^ +[0-9a-f]+:\t/ {
+	n = split($0, f, "\t")
+	addr = $1
+	sub(/:$/, "", addr)
+	bytes = f[2]
+	gsub(/[^0-9a-f]/, "", bytes)
+	bytes = length(bytes) / 2
+	fsize[func_] += bytes
+	if (n < 3) {
+		# long instruction wrapped by objdump, only fetches remain
+		fcycles[func_] += slow(hex(addr)) ? 4 * int(bytes / 2) : 0
+		next
+	}
+	fcycles[func_] += cycles(hex(addr), int(bytes / 2), tolower(f[3]))
+	next
+}
+
+END {
+	if (!side) {
+		printf "# cycles: each instruction once, loops not multiplied\n"
+		printf "# %-22s %6s %7s\n", "function", "bytes", "cycles"
+		for (i = 1; i <= nfuncs; i++)
+			printf "%-24s %6d %7d\n", order[i], fsize[order[i]], fcycles[order[i]]
+		printf "# %-22s %6s %7s %6s\n", "region", "used", "size", "free"
+		for (r = 1; r <= nregions; r++) {
+			n = regions[r]
+			printf "%-24s %6d %7d %6d\n", n, used[n], length_[n], length_[n] - used[n]
+		}
+	}
+	for (m in unknown)
+		printf "report.awk: no timing for '%s', assumed 14 cycles\n", m > "/dev/stderr"
+
+	if (base == "")
+		exit
+	if ((getline line < base) < 0) {
+		printf "report.awk: ********************************************************\n" \
+			"report.awk: WARNING: no baseline %s, size and cycle\n" \
+			"report.awk: WARNING: regressions are NOT checked.  Build the last\n" \
+			"report.awk: WARNING: commit, run 'make report-baseline' and commit\n" \
+			"report.awk: WARNING: %s.\n" \
+			"report.awk: ********************************************************\n", \
+			base, base > "/dev/stderr"
+		exit
+	}
+	do {
+		if (line ~ /^#/) {
+			section = line ~ /region/
+			continue
+		}
+		split(line, f, " ")
+		if (!section)
+			old[f[1]] = f[2] " " f[3]
+		else
+			oldfree[f[1]] = f[4]
+	} while ((getline line < base) > 0)
+
+	if (side) {
+		printf "%-24s %6s %6s %7s %7s\n", "function", "bytes", "", "cycles", ""
+		printf "%-24s %6s %6s %7s %7s\n", "", "base", "new", "base", "new"
+		for (i = 1; i <= nfuncs; i++) {
+			n = order[i]
+			split(n in old ? old[n] : "0 0", f, " ")
+			printf "%-24s %6d %6d %7d %7d\n", n, f[1], fsize[n], f[2], fcycles[n]
+			tb += f[1]; tc += f[2]; ts += fsize[n]; tt += fcycles[n]
+		}
+		printf "%-24s %6d %6d %7d %7d\n", "total", tb, ts, tc, tt
+		for (r = 1; r <= nregions; r++) {
+			n = regions[r]
+			printf "%-24s free %6d -> %d\n", n, oldfree[n], length_[n] - used[n]
+		}
+		exit
+	}
+	for (i = 1; i <= nfuncs; i++) {
+		n = order[i]
+		if (!(n in old)) {
+			printf "%s: new function %s: %d bytes, %d cycles\n", base, n, fsize[n], fcycles[n] > "/dev/stderr"
+			continue
+		}
+		split(old[n], f, " ")
+		if (fsize[n] > f[1] || fcycles[n] > f[2])
+			printf "%s: %s grew: %d -> %d bytes, %d -> %d cycles\n", base, n, f[1], fsize[n], f[2], fcycles[n] > "/dev/stderr"
+	}
+	for (r = 1; r <= nregions; r++) {
+		n = regions[r]
+		if ((n in oldfree) && length_[n] - used[n] < oldfree[n])
+			printf "%s: %s headroom shrank: %d -> %d bytes\n", base, n, oldfree[n], length_[n] - used[n] > "/dev/stderr"
+	}
+}
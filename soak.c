@@ -0,0 +1,577 @@
+/*
+ *  soak.c - headless soak runner for the Turmoil clone
+ *
+ * Builds the game from main.c for the host (see the HOST section there)
+ * and plays many independent sessions in parallel, one process per
+ * session.  Each session gets its own random() seed and a random
+ * joystick, and runs for a fixed number of frames.  The runner gathers
+ * VDP and sound chip traffic per frame, the heaviest frames, and any
+ * broken game state invariants.
+ *
+ * usage: turmoil-soak [-n sessions] [-f frames] [-j jobs] [-s seed]
+ *                     [-l level] [-L snapshot] [-S snapshot]
+ *                     [-G golden] [-g golden]
+ *
+ * -l starts every game on the given level.  -L starts every session from
+ * a game state saved with -S, which saves session 0 on the first frame
+ * of the highest level it reached, so a run can begin where the load is
+ * heaviest.
+ *
+ * -G hashes all of VRAM and the VDP registers on every frame of every
+ * session into a file, -g compares a run with the same options against
+ * it, or against its first sessions with a smaller -n.  The sessions are
+ * the same every time, so a change that should look the same can be
+ * checked frame by frame.  A session that differs stops there and leaves
+ * golden-SESSION-FRAME.ppm, its screen drawn the way the VDP shows it.
+ *
+ * The game is built with its event log (EVENT_LOG in main.c).  The
+ * heaviest frames are listed with the events that happened in them, and
+ * a session that breaks an invariant leaves events-SESSION.txt, the last
+ * events before it, oldest first.
+ *
+ * Host timing says nothing about the TMS9900, so frame cost is reported
+ * as VDP bytes and address setups, the two things the frame loop spends
+ * most of its time on.  Setups that vdp_seek() in main.c left out because
+ * the VDP address was already there are counted apart, and the host VDP
+ * checks that it really was.
+ */
+
+#define HOST
+#define EVENT_LOG
+#define main turmoil_main
+#include "main.c"
+#undef main
+
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+
+#define HIST 32		// VDP bytes per frame histogram, 64 byte buckets
+#define WORST 10	// heaviest frames kept
+#define STUCK 1000	// frames countdown may stay unchanged, longer than
+			// death_task() with game over and rainbow() back to back
+
+struct frame_info {
+	unsigned session;
+	unsigned frame;
+	u16 bytes;
+	u16 setups;
+	u16 level;
+	char events[64]; // what happened in the frame
+};
+
+struct result {
+	unsigned frames;
+	unsigned games;
+	u16 max_level;
+	u16 max_setups;
+	u16 max_skipped;
+	u16 max_sound;
+	unsigned long long bytes, setups, skipped, sound;
+	unsigned hist[HIST];
+	struct frame_info worst;
+	unsigned bad_frame;
+	char bad[96]; // empty if no invariant was broken
+};
+
+static unsigned frames;
+static struct result res;
+static unsigned rng;
+static u16 input = 0xff00, hold;
+static u16 last_countdown, same_countdown;
+static u8 was_demo = 1;
+static struct snapshot snap; // -L, or the one being saved with -S
+static u8 load_snap;
+static const char *save_snap;
+static u16 snap_level;
+static unsigned session;
+
+// -G and -g, a header and then a hash per frame per session
+struct golden_header {
+	char magic[8];
+	unsigned sessions, frames, base, level;
+};
+static int golden_fd = -1;
+static u8 golden_check;
+
+static unsigned xorshift(void)
+{
+	rng ^= rng << 13;
+	rng ^= rng >> 17;
+	rng ^= rng << 5;
+	return rng;
+}
+
+static u16 host_joystick(void)
+{
+	return input;
+}
+
+static void finish(void)
+{
+	if (save_snap && snap_level) {
+		FILE *f = fopen(save_snap, "wb");
+		if (!f || fwrite(&snap, sizeof(snap), 1, f) != 1 || fclose(f) != 0)
+			perror(save_snap);
+	}
+	if (write(STDOUT_FILENO, &res, sizeof(res)) != sizeof(res))
+		_exit(1);
+	_exit(0);
+}
+
+static const char *const event_names[] = {
+	"", "spawn", "kill", "push", "prize", "saucer", "ship", "overrun", "level",
+};
+static const char *const type_names[] = {
+	"idle", "flutter", "flipper", "hotdog", "delta", "phi", "prize",
+	"arrow", "saucer", "ball", "tank", "explode",
+};
+
+// one event of the log as text, "kill 3 tank"
+static int event_text(char *buf, size_t size, u16 what)
+{
+	u16 kind = what >> 12, row = (what >> 8) & 15, arg = what & 0xff;
+
+	if (kind == 0 || kind > EV_LEVEL)
+		return snprintf(buf, size, "?%04x", what);
+	switch (kind) {
+	case EV_SPAWN:
+	case EV_KILL:
+		return snprintf(buf, size, "%s %u %s", event_names[kind], row,
+			arg <= EXPLODE ? type_names[arg] : "?");
+	case EV_PUSH:
+	case EV_SAUCER:
+		return snprintf(buf, size, "%s %u x %u", event_names[kind], row, arg);
+	case EV_PRIZE:
+		return snprintf(buf, size, "%s %u", event_names[kind], row);
+	case EV_SHIP:
+		return snprintf(buf, size, "%s %u, %u left", event_names[kind], row, arg);
+	case EV_LEVEL:
+		return snprintf(buf, size, "%s %u", event_names[kind], arg);
+	}
+	return snprintf(buf, size, "%s", event_names[kind]);
+}
+
+// the events of the frame in progress, comma separated
+static void frame_events(char *buf, size_t size)
+{
+	u16 frame = events.frame - 1; // vsync() counted it already
+	size_t n = 0;
+
+	buf[0] = 0;
+	for (u16 i = 0; i < EVENT_LOG_SIZE && n < size; i++) {
+		const u16 *e = &events.ring[(events.head + i * 2) & (EVENT_LOG_SIZE * 2 - 1)];
+		if (e[1] == 0 || e[0] != frame)
+			continue;
+		if (n)
+			n += snprintf(buf + n, size - n, ", ");
+		if (n < size)
+			n += event_text(buf + n, size - n, e[1]);
+	}
+}
+
+// the whole log, oldest first
+static void dump_events(const char *name)
+{
+	FILE *f = fopen(name, "w");
+	if (!f) {
+		perror(name);
+		return;
+	}
+	for (u16 i = 0; i < EVENT_LOG_SIZE; i++) {
+		const u16 *e = &events.ring[(events.head + i * 2) & (EVENT_LOG_SIZE * 2 - 1)];
+		char text[32];
+		if (e[1] == 0)
+			continue;
+		event_text(text, sizeof(text), e[1]);
+		fprintf(f, "%5u %s\n", e[0], text);
+	}
+	fclose(f);
+}
+
+static void violation(const char *what, int a, int b)
+{
+	char name[32];
+
+	snprintf(name, sizeof(name), "events-%u.txt", session);
+	dump_events(name);
+	res.bad_frame = res.frames;
+	snprintf(res.bad, sizeof(res.bad), what, a, b);
+	finish();
+}
+
+static void check(void)
+{
+	u16 frame = events.frame - 1;
+
+	for (u16 i = 0; i < 7; i++) {
+		if (enemy[i].type != IDLE && enemy[i].x >= 0xf000)
+			violation("enemy in row %d past the edge, x %04x", i, enemy[i].x);
+		if (enemy[i].type > EXPLODE)
+			violation("enemy in row %d has type %d", i, enemy[i].type);
+	}
+	// the edge code puts a tank pushed past the edge back in the same
+	// step, so only its push event shows it
+	for (u16 i = 0; i < EVENT_LOG_SIZE; i++) {
+		const u16 *e = &events.ring[(events.head + i * 2) & (EVENT_LOG_SIZE * 2 - 1)];
+		if (e[0] == frame && e[1] >> 12 == EV_PUSH && (e[1] & 0xff) >= 0xf0)
+			violation("tank in row %d pushed past the edge, x %02x00",
+				(e[1] >> 8) & 15, e[1] & 0xff);
+	}
+	if (!demo && ships > 5)
+		violation("ships %d level %d", ships, level);
+	if (countdown != 0 && countdown == last_countdown) {
+		if (++same_countdown > STUCK)
+			violation("countdown stuck at %d for %d frames", countdown, STUCK);
+	} else {
+		same_countdown = 0;
+	}
+	last_countdown = countdown;
+}
+
+// The screen in bitmap mode with 16x16 sprites, as set up by vdpini[].
+// No fifth sprite limit.
+static void render(const char *name)
+{
+	static const u8 palette[16][3] = {
+		{0,0,0}, {0,0,0}, {33,200,66}, {94,220,120},
+		{84,85,237}, {125,118,252}, {212,82,77}, {66,235,245},
+		{252,85,84}, {255,121,120}, {212,193,84}, {230,206,128},
+		{33,176,59}, {201,91,186}, {204,204,204}, {255,255,255},
+	};
+	static u8 pix[192][256];
+	u16 scr = vdp_regs[2] * 0x400;
+	u16 clr = vdp_regs[3] & 0x80 ? 0x2000 : 0;
+	u16 pat = vdp_regs[4] & 4 ? 0x2000 : 0;
+	u16 spr = vdp_regs[5] * 0x80;
+	u16 spat = (vdp_regs[6] & 7) * 0x800;
+
+	for (int y = 0; y < 192; y++) {
+		for (int x = 0; x < 256; x++) {
+			u16 at = (y / 64) * 0x800 + vram[scr + (y / 8) * 32 + x / 8] * 8 + (y & 7);
+			u8 c = vram[clr + at];
+			c = vram[pat + at] & (0x80 >> (x & 7)) ? c >> 4 : c & 15;
+			pix[y][x] = c ? c : vdp_regs[7] & 15;
+		}
+	}
+
+	int n = 0;
+	while (n < 32 && vram[spr + n * 4] != 0xd0)
+		n++;
+	// lower numbers are in front
+	while (n--) {
+		const u8 *s = &vram[spr + n * 4];
+		int sy = s[0] >= 0xe1 ? s[0] - 255 : s[0] + 1;
+		int sx = s[3] & 0x80 ? s[1] - 32 : s[1];
+		u8 c = s[3] & 15;
+		if (c == 0)
+			continue;
+		for (int r = 0; r < 16; r++) {
+			for (int col = 0; col < 16; col++) {
+				int y = sy + r, x = sx + col;
+				u8 b = vram[spat + (s[2] & 0xfc) * 8 + (col & 8) * 2 + r];
+				if (y >= 0 && y < 192 && x >= 0 && x < 256 && (b & (0x80 >> (col & 7))))
+					pix[y][x] = c;
+			}
+		}
+	}
+
+	FILE *f = fopen(name, "wb");
+	if (!f) {
+		perror(name);
+		return;
+	}
+	fprintf(f, "P6\n256 192\n255\n");
+	for (int y = 0; y < 192; y++)
+		for (int x = 0; x < 256; x++)
+			fwrite(palette[pix[y][x]], 3, 1, f);
+	fclose(f);
+}
+
+static void golden_frame(void)
+{
+	unsigned h = 2166136261u;
+	for (unsigned i = 0; i < sizeof(vram); i++)
+		h = (h ^ vram[i]) * 16777619u;
+	for (unsigned i = 0; i < sizeof(vdp_regs); i++)
+		h = (h ^ vdp_regs[i]) * 16777619u;
+
+	off_t at = sizeof(struct golden_header) + ((off_t)session * frames + res.frames) * sizeof(h);
+	if (!golden_check) {
+		if (pwrite(golden_fd, &h, sizeof(h), at) != sizeof(h))
+			violation("can't write the golden file", 0, 0);
+		return;
+	}
+	unsigned g;
+	if (pread(golden_fd, &g, sizeof(g), at) != sizeof(g) || g != h) {
+		char name[40];
+		snprintf(name, sizeof(name), "golden-%u-%u.ppm", session, res.frames);
+		render(name);
+		violation("screen differs from the golden file, level %d", level, 0);
+	}
+}
+
+// random joystick: hold a direction for a while, fire often
+static void next_input(void)
+{
+	static const u16 dirs[] = {
+		0, JOYSTICK_UP, JOYSTICK_DOWN, JOYSTICK_LEFT, JOYSTICK_RIGHT,
+	};
+
+	if (hold) {
+		hold--;
+		return;
+	}
+	unsigned r = xorshift();
+	input = 0xff00 & ~dirs[r % 5];
+	if (r & 0x100)
+		input &= ~JOYSTICK_FIRE;
+	hold = (r >> 16) & 31;
+}
+
+static void host_frame(void)
+{
+	// frame 0 includes setup(), leave it out of the statistics
+	if (res.frames == 0 && load_snap)
+		snapshot_load(&snap);
+	if (res.frames != 0) {
+		res.bytes += traffic.bytes;
+		res.setups += traffic.setups;
+		res.skipped += traffic.skipped;
+		res.sound += traffic.sound;
+		res.hist[traffic.bytes / 64 < HIST ? traffic.bytes / 64 : HIST - 1]++;
+		if (traffic.setups > res.max_setups)
+			res.max_setups = traffic.setups;
+		if (traffic.skipped > res.max_skipped)
+			res.max_skipped = traffic.skipped;
+		if (traffic.sound > res.max_sound)
+			res.max_sound = traffic.sound;
+		if (traffic.bytes > res.worst.bytes) {
+			res.worst.frame = res.frames;
+			res.worst.bytes = traffic.bytes;
+			res.worst.setups = traffic.setups;
+			res.worst.level = level;
+			frame_events(res.worst.events, sizeof(res.worst.events));
+		}
+	}
+	if (traffic.lost)
+		violation("%d address setups skipped with the VDP elsewhere", traffic.lost, 0);
+	memset(&traffic, 0, sizeof(traffic));
+
+	// the attract mode replay isn't a game
+	u8 playing = !demo && !replay;
+	if (was_demo && playing)
+		res.games++;
+	was_demo = !playing;
+	if (playing && level > res.max_level)
+		res.max_level = level;
+	if (save_snap && playing && !transition && level > snap_level) {
+		snapshot_save(&snap);
+		snap_level = level;
+	}
+
+	check();
+	if (golden_fd >= 0)
+		golden_frame();
+	if (++res.frames >= frames)
+		finish();
+	next_input();
+}
+
+static void run(unsigned n, u16 s)
+{
+	seed = s;
+	rng = s * 2654435761u + 1;
+	session = n;
+	res.worst.session = n;
+	if (n != 0)
+		save_snap = 0;
+	turmoil_main();
+	finish();
+}
+
+static u16 session_seed(unsigned base, unsigned n)
+{
+	u16 s = base + n * 40503u;
+	return s ? s : 1;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned sessions = 1000, base = 1;
+	long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+	const char *golden = 0;
+	int c;
+
+	frames = 36000;
+	while ((c = getopt(argc, argv, "n:f:j:s:l:L:S:G:g:")) != -1) {
+		switch (c) {
+		case 'n': sessions = strtoul(optarg, 0, 0); break;
+		case 'f': frames = strtoul(optarg, 0, 0); break;
+		case 'j': jobs = strtol(optarg, 0, 0); break;
+		case 's': base = strtoul(optarg, 0, 0); break;
+		case 'l': start_level = strtoul(optarg, 0, 0); break;
+		case 'L': {
+			FILE *f = fopen(optarg, "rb");
+			if (!f || fread(&snap, sizeof(snap), 1, f) != 1 || snap.size != sizeof(snap)) {
+				fprintf(stderr, "%s: not a snapshot\n", optarg);
+				return 1;
+			}
+			fclose(f);
+			load_snap = 1;
+			break;
+		}
+		case 'S': save_snap = optarg; break;
+		case 'G': golden = optarg; golden_check = 0; break;
+		case 'g': golden = optarg; golden_check = 1; break;
+		default:
+			fprintf(stderr, "usage: %s [-n sessions] [-f frames] [-j jobs] [-s seed]"
+				" [-l level] [-L snapshot] [-S snapshot] [-G golden] [-g golden]\n",
+				argv[0]);
+			return 2;
+		}
+	}
+	if (start_level < 1 || start_level > 9) {
+		fprintf(stderr, "level must be 1 to 9\n");
+		return 2;
+	}
+	if (jobs < 1)
+		jobs = 1;
+
+	if (golden) {
+		struct golden_header want = {"turmoilG", sessions, frames, base, start_level}, h;
+		golden_fd = open(golden, golden_check ? O_RDONLY : O_RDWR | O_CREAT | O_TRUNC, 0666);
+		if (golden_fd < 0) {
+			perror(golden);
+			return 1;
+		}
+		if (!golden_check) {
+			if (write(golden_fd, &want, sizeof(want)) != sizeof(want)) {
+				perror(golden);
+				return 1;
+			}
+		} else if (read(golden_fd, &h, sizeof(h)) != sizeof(h) || memcmp(h.magic, want.magic, 8)) {
+			fprintf(stderr, "%s: not a golden file\n", golden);
+			return 1;
+		} else if (h.frames != frames || h.base != base || h.level != start_level ||
+			h.sessions < sessions) {
+			fprintf(stderr, "%s was made with -n %u -f %u -s %u -l %u\n",
+				golden, h.sessions, h.frames, h.base, h.level);
+			return 1;
+		}
+	}
+
+	printf("%u sessions x %u frames, %ld jobs\n", sessions, frames, jobs);
+	fflush(stdout);
+
+	pid_t pid[jobs];
+	int fd[jobs];
+	unsigned which[jobs];
+	struct result total;
+	struct frame_info worst[WORST];
+	unsigned levels[10] = {0}, bad = 0, next = 0, running = 0;
+
+	memset(&total, 0, sizeof(total));
+	memset(worst, 0, sizeof(worst));
+	for (long j = 0; j < jobs; j++)
+		pid[j] = 0;
+
+	while (next < sessions || running) {
+		while (next < sessions && running < jobs) {
+			long j = 0;
+			int p[2];
+			while (pid[j])
+				j++;
+			if (pipe(p) < 0) {
+				perror("pipe");
+				return 1;
+			}
+			pid[j] = fork();
+			if (pid[j] < 0) {
+				perror("fork");
+				return 1;
+			}
+			if (pid[j] == 0) {
+				close(p[0]);
+				dup2(p[1], STDOUT_FILENO);
+				run(next, session_seed(base, next));
+			}
+			close(p[1]);
+			fd[j] = p[0];
+			which[j] = next++;
+			running++;
+		}
+
+		int status;
+		pid_t done = wait(&status);
+		long j = 0;
+		while (j < jobs && pid[j] != done)
+			j++;
+		if (j == jobs)
+			continue;
+
+		struct result r;
+		if (read(fd[j], &r, sizeof(r)) != sizeof(r)) {
+			printf("session %u seed 0x%04x: no result, status %d\n",
+				which[j], session_seed(base, which[j]), status);
+			bad++;
+		} else {
+			total.frames += r.frames;
+			total.games += r.games;
+			total.bytes += r.bytes;
+			total.setups += r.setups;
+			total.skipped += r.skipped;
+			total.sound += r.sound;
+			for (int i = 0; i < HIST; i++)
+				total.hist[i] += r.hist[i];
+			if (r.max_setups > total.max_setups)
+				total.max_setups = r.max_setups;
+			if (r.max_skipped > total.max_skipped)
+				total.max_skipped = r.max_skipped;
+			if (r.max_sound > total.max_sound)
+				total.max_sound = r.max_sound;
+			levels[r.max_level < 10 ? r.max_level : 9]++;
+			for (int i = 0; i < WORST; i++) {
+				if (r.worst.bytes > worst[i].bytes) {
+					memmove(worst + i + 1, worst + i, (WORST - i - 1) * sizeof(*worst));
+					worst[i] = r.worst;
+					break;
+				}
+			}
+			if (r.bad[0]) {
+				printf("session %u seed 0x%04x frame %u: %s\n",
+					which[j], session_seed(base, which[j]), r.bad_frame, r.bad);
+				bad++;
+			}
+		}
+		close(fd[j]);
+		pid[j] = 0;
+		running--;
+	}
+
+	unsigned n = total.frames > sessions ? total.frames - sessions : 1;
+	printf("frames %u, games %u\n", total.frames, total.games);
+	printf("highest level reached:");
+	for (int i = 1; i < 10; i++)
+		printf(" %d:%u", i, levels[i]);
+	printf("\n");
+	printf("VDP bytes per frame: avg %.1f\n", (double)total.bytes / n);
+	for (int i = 0; i < HIST; i++) {
+		if (total.hist[i])
+			printf("  %4d-%-4d %10u\n", i * 64, i == HIST - 1 ? 9999 : i * 64 + 63, total.hist[i]);
+	}
+	printf("VDP address setups per frame: avg %.1f max %u\n", (double)total.setups / n, total.max_setups);
+	printf("  skipped by vdp_seek(): avg %.1f max %u\n", (double)total.skipped / n, total.max_skipped);
+	printf("sound writes per frame: avg %.2f max %u\n", (double)total.sound / n, total.max_sound);
+	printf("heaviest frames:\n");
+	for (int i = 0; i < WORST && worst[i].bytes; i++) {
+		printf("  session %u seed 0x%04x frame %u level %u: %u bytes, %u setups\n",
+			worst[i].session, session_seed(base, worst[i].session), worst[i].frame,
+			worst[i].level, worst[i].bytes, worst[i].setups);
+		if (worst[i].events[0])
+			printf("    %s\n", worst[i].events);
+	}
+	printf("invariant violations: %u\n", bad);
+	return bad != 0;
+}